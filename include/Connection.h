@@ -9,8 +9,14 @@
 #include "Promise.h"
 #include "nlohmann/json.hpp"
 #include "Observable.h"
+#include "SnapshotStore.h"
+#include "Runtime.h"
+#include "LingerPool.h"
+#include "JsonArena.h"
+#include "Threading.h"
 #include <WebSocket.h>
 #include <condition_variable>
+#include <atomic>
 
 #ifndef _NOEXCEPT
 #define _NOEXCEPT _GLIBCXX_USE_NOEXCEPT _GLIBCXX_TXN_SAFE_DYN
@@ -43,20 +49,54 @@ namespace livechange {
     virtual const char* what() const _NOEXCEPT override { return message.c_str(); }
   };
 
+  class ObservationSettings {
+  public:
+    /// Deliver notify signals to observables as "batch" signals instead of one by one
+    bool batchSignals = false;
+    /// Zero means signals are batched only within one received frame
+    std::chrono::steady_clock::duration batchWindow = std::chrono::duration<int,std::milli>(0);
+    /// How long observation stays subscribed after last observable is removed
+    std::chrono::steady_clock::duration linger = std::chrono::duration<int,std::milli>(0);
+    /// After reconnect ask server for signals after last applied "seq" instead of full state
+    bool resume = false;
+  };
+
   class Observation {
   protected:
     std::weak_ptr<Connection> connection; /// CIRCURAL REFERENCE, CONVERT TO WEAKPTR!!!
     nlohmann::json path;
+    ObservationSettings settings;
     std::vector<std::shared_ptr<Observable>> observables;
     std::vector<nlohmann::json> cachedSignals;
-    std::mutex stateMutex;
+    std::vector<nlohmann::json> pendingSignals;
+    std::chrono::steady_clock::time_point batchDeadline;
+    bool snapshotLoaded = false;
+    bool fromSnapshot = false; /// cachedSignals come from snapshot store, not from server
+    bool snapshotDirty = false; /// cachedSignals changed since last save
+    bool lingering = false;
+    std::chrono::steady_clock::time_point lingerStart;
+    std::chrono::steady_clock::time_point lingerDeadline;
+    std::atomic<size_t> lingerSize{0}; /// estimated memory used by cachedSignals, read by LingerPool
+    bool lingerEvicted = false; /// LingerPool went over budget, connection unobserves it on next timeout pass
+    bool hasSequence = false;
+    uint64_t lastSequence = 0;
+    bool resyncing = false;
+    bool resumePending = false; /// resume observe sent, any set answering it is accepted whatever its seq
+    Mutex stateMutex;
+    friend class Connection;
+    friend class LingerPool;
 
     void addObservable(std::shared_ptr<Observable> observable);
     void removeObservable(std::shared_ptr<Observable> observable);
     void addReactions(std::shared_ptr<Observable> observable);
+    void loadSnapshot();
+    void stopObserving(std::shared_ptr<Connection> connectionPtr);
+    void resync();
   public:
 
-    Observation(std::shared_ptr<Connection> connectionp, nlohmann::json pathp) : connection(connectionp), path(pathp) {
+    Observation(std::shared_ptr<Connection> connectionp, nlohmann::json pathp,
+                ObservationSettings settingsp = ObservationSettings())
+        : connection(connectionp), path(pathp), settings(settingsp) {
     }
     template<typename T> std::shared_ptr<T> observable() {
       int type = T::type;
@@ -73,7 +113,9 @@ namespace livechange {
     }
     void handleDisconnect();
     void handleConnect();
-    void handleNotifyMessage(const nlohmann::json& message);
+    void handleNotifyMessage(nlohmann::json message);
+    void flushSignals();
+    void saveSnapshot();
   };
 
   class RequestSettings {
@@ -81,23 +123,42 @@ namespace livechange {
     std::chrono::steady_clock::duration timeout = std::chrono::duration<int,std::milli>(10000);
     std::chrono::steady_clock::duration sentTimeout = std::chrono::duration<int,std::milli>(2300);
     bool queueWhenDisconnected = false;
+    /// Use timeout derived from measured round trip time when it is shorter than timeout
+    bool adaptiveTimeout = false;
+    std::chrono::steady_clock::duration minTimeout = std::chrono::duration<int,std::milli>(1000);
+  };
+
+  class HeartbeatSettings {
+  public:
+    bool enabled = false;
+    std::chrono::steady_clock::duration interval = std::chrono::duration<int,std::milli>(2000);
+    /// Connection is closed when this many pings in a row are not answered
+    int maxMissed = 3;
+  };
+
+  class PathResult {
+  public:
+    nlohmann::json result;
+    std::exception_ptr error;
   };
 
+  using PathResults = std::map<nlohmann::json, PathResult>;
+
   class Request : public std::enable_shared_from_this<Request> {
   public:
     int requestId;
-    nlohmann::json message;
+    std::string data; /// message serialized once, reused on every resend
     std::chrono::steady_clock::time_point startPoint;
     bool hasTimeout;
     std::chrono::steady_clock::time_point timeoutPoint;
     std::shared_ptr<Promise<nlohmann::json>> resultPromise;
     RequestSettings settings;
     std::weak_ptr<Connection> connection;
-    std::mutex stateMutex;
+    Mutex stateMutex;
 
     Request(std::shared_ptr<Connection> connectionp, int requestIdp,
             nlohmann::json msgp, RequestSettings settingsp);
-    void handleMessage(const nlohmann::json message);
+    void handleMessage(const ArenaJson& message);
     void handleDisconnect();
     void handleTimeout();
   };
@@ -107,39 +168,112 @@ namespace livechange {
     std::string url;
     nlohmann::json sessionId;
 
+    Mutex observationsMutex; /// guards observations and lingeringObservations, only LingerPool is called while held
     std::map<nlohmann::json, std::shared_ptr<Observation>> observations;
+    std::vector<std::shared_ptr<Observation>> lingeringObservations;
+    ObservationSettings observationSettings;
+    std::vector<std::shared_ptr<Observation>> batchingObservations;
+    std::shared_ptr<SnapshotStore> snapshotStore;
     std::vector<std::shared_ptr<Request>> waitingRequests;
     std::vector<std::shared_ptr<Request>> requestsQueue;
     int lastRequestId;
 
     std::shared_ptr<wsxx::WebSocket> webSocket;
+    uint64_t socketGeneration; /// incremented when webSocket is replaced or dropped
     friend class Observation;
     friend class Request;
 
-    void handleOpen();
-    void handleMessage(std::string data, wsxx::WebSocket::PacketType type);
-    void handleClose(int code, std::string reason, bool wasClean);
+    std::shared_ptr<Observation> findObservation(const nlohmann::json& path);
+    std::vector<std::shared_ptr<Observation>> allObservations();
+    void forgetObservation(Observation* observation);
+
+    /// Callbacks carry generation of socket they came from, those of replaced sockets are dropped
+    void handleOpen(uint64_t generation);
+    void handleMessage(const std::string& data, wsxx::WebSocket::PacketType type, uint64_t generation);
+    void handleMessageObject(ArenaJson& msg);
+    void flushBatches(std::chrono::steady_clock::time_point now, bool force = false);
+    void handleClose(int code, std::string reason, bool wasClean, uint64_t generation);
+    void handleDisconnected();
+    void handlePong(const ArenaJson& msg);
 
     void send(const nlohmann::json& msg);
+    void sendData(const std::string& data); /// stored request data, copied only when corked
+    void sendData(std::string&& data); /// transient messages
+    void cork();
+    void uncork();
     std::shared_ptr<Promise<nlohmann::json>> sendRequest(
         const nlohmann::json& msg, RequestSettings settings = RequestSettings());
+    /// Requests share one deadline and timer registration and go out in one corked batch
+    std::vector<std::shared_ptr<Promise<nlohmann::json>>> sendRequests(
+        const std::vector<nlohmann::json>& msgs, RequestSettings settings = RequestSettings());
+    void adaptTimeout(RequestSettings& settings);
 
-    std::mutex stateMutex;
+    Mutex sendMutex;
+    int corked;
+    bool frameBatching;
+    std::vector<std::string> outgoingBatch;
+
+    Mutex stateMutex;
+    JsonArena receiveArena; /// received messages are parsed here, reset for every frame
     int connectedCounter;
+#ifndef LIVECHANGE_SINGLE_THREADED
     std::thread timeoutThread;
     std::condition_variable timeoutCondition;
+    std::mutex timeoutWakeMutex; /// taken without stateMutex, so wakes from removeObservable are not lost
+    bool timeoutRescan = false; /// deadlines changed since timeout thread last scanned them
+    void wakeTimeoutThread();
+#else
+    std::function<void(std::chrono::steady_clock::time_point)> timeoutWake;
+#endif
+
+    std::shared_ptr<Runtime> runtime;
+    size_t runtimeLoop;
+    Mutex runtimeTimerMutex; /// guards timer fields below, so timeouts can be scheduled without stateMutex
+    bool runtimeTimerScheduled;
+    std::chrono::steady_clock::time_point runtimeTimerPoint;
+    uint64_t runtimeTimerGeneration; /// timers replaced by earlier one are ignored when they fire
+    friend class Runtime;
+
+    std::shared_ptr<LingerPool> lingerPool;
+    friend class LingerPool;
+
+    HeartbeatSettings heartbeatSettings;
+    bool heartbeatActive;
+    bool heartbeatPending;
+    int lastHeartbeatId;
+    int missedHeartbeats;
+    std::atomic<bool> linkDead; /// socket closed by client, disconnect already handled, onClose is ignored
+    std::chrono::steady_clock::time_point heartbeatSent;
+    std::chrono::steady_clock::time_point nextHeartbeat;
+    bool rttMeasured;
+    std::chrono::steady_clock::duration smoothedRtt;
+    std::chrono::steady_clock::duration rttVariation;
+
+    std::chrono::steady_clock::duration roundTripTimeout();
+
+    bool processTimeouts(std::chrono::steady_clock::time_point now,
+                         std::chrono::steady_clock::time_point& next_timeout);
+    void scheduleTimeouts(std::chrono::steady_clock::time_point at); /// does not need stateMutex
+    void expireLingering(std::chrono::steady_clock::time_point now);
+    void handleRuntimeTimer(uint64_t generation);
 
   public:
-    Connection(std::string urlp, nlohmann::json sessionIdp);
+    Connection(std::string urlp, nlohmann::json sessionIdp,
+               ObservationSettings observationSettingsp = ObservationSettings());
     ~Connection();
     void init();
+#ifndef LIVECHANGE_SINGLE_THREADED
+    /// Timeouts are handled by one of runtime threads instead of own thread
+    void init(std::shared_ptr<Runtime> runtimep);
+#endif
 
     std::shared_ptr<Observation> observation(nlohmann::json path) {
+      std::lock_guard<Mutex> guard(observationsMutex);
       auto it = observations.find(path);
       if(it != observations.end()) {
         return it->second;
       }
-      auto observation = std::make_shared<Observation>(shared_from_this(), path);
+      auto observation = std::make_shared<Observation>(shared_from_this(), path, observationSettings);
       observations[path] = observation;
       return observation;
     }
@@ -149,14 +283,57 @@ namespace livechange {
       return observationInstance->observable<T>();
     }
 
+    template<typename T> std::vector<std::shared_ptr<T>> observeMany(std::vector<nlohmann::json> paths) {
+      std::vector<std::shared_ptr<T>> result;
+      cork();
+      for(auto& path : paths) {
+        result.push_back(observable<T>(path));
+      }
+      uncork();
+      return result;
+    }
+
     std::shared_ptr<Promise<nlohmann::json>> get(nlohmann::json path,
                                          RequestSettings settings = RequestSettings());
+    /// Protocol has no multi-path get, so every path is still its own get message and response,
+    /// but they are sent in one frame (with frame batching) and time out together on one deadline.
+    std::shared_ptr<Promise<PathResults>> getMany(std::vector<nlohmann::json> paths,
+                                                  RequestSettings settings = RequestSettings());
     std::shared_ptr<Promise<nlohmann::json>> request(nlohmann::json method, nlohmann::json args,
                                              RequestSettings settings = RequestSettings());
 
     bool isConnected();
 
+    /// Runs due timeouts, returns when next one is due or time_point::max() when none is pending.
+    /// Needed in LIVECHANGE_SINGLE_THREADED builds, where init() starts no timeout thread.
+    std::chrono::steady_clock::time_point poll(
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+#ifdef LIVECHANGE_SINGLE_THREADED
+    /// Called with new deadline whenever one is added (request sent, heartbeat, batch window),
+    /// event loop should rearm its poll() timer if it is earlier. Runs inside connection calls,
+    /// must not call poll() or other connection methods itself.
+    void setTimeoutWake(std::function<void(std::chrono::steady_clock::time_point)> wake);
+#endif
+    /// Server accepts frames containing JSON array of messages
+    void setFrameBatching(bool enabled);
+
+    /// Observations load their last known state from store before server sends it
+    void setSnapshotStore(std::shared_ptr<SnapshotStore> store);
+    void saveSnapshots();
+
+    /// Lingering observations of all connections using the pool share its memory budget,
+    /// LingerPool::shared() by default. Call before observing.
+    void setLingerPool(std::shared_ptr<LingerPool> pool);
+
+    /// Takes effect on next connect
+    void setHeartbeat(HeartbeatSettings settings);
+    /// Smoothed round trip time and its variation measured by heartbeat, zero before first pong
+    std::chrono::steady_clock::duration roundTripTime();
+    std::chrono::steady_clock::duration roundTripJitter();
+
     void connect();
+    /// Closes the socket, requests and observations handle disconnect now instead of on its onClose
+    void disconnect();
   };
 
 }
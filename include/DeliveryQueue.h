@@ -0,0 +1,71 @@
+#ifndef LIVECHANGE_DELIVERYQUEUE_H
+#define LIVECHANGE_DELIVERYQUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include "Observable.h"
+
+namespace livechange {
+
+  using Executor = std::function<void (std::function<void ()> task)>;
+
+  enum class OverflowPolicy {
+    Conflate = 0,     /// set replaces queued signals, updateByField merges with queued update of same key
+    DropAndResync = 1 /// queued signals are replaced with set of current state
+  };
+
+  class DeliverySettings {
+  public:
+    Executor executor; /// delivers on the thread firing signals when empty
+    size_t capacity = 1000;
+    OverflowPolicy overflow = OverflowPolicy::Conflate;
+  };
+
+  class DeliveryMetrics {
+  public:
+    size_t queued = 0;
+    uint64_t delivered = 0;
+    uint64_t conflated = 0;
+    uint64_t resyncs = 0;
+    std::chrono::steady_clock::duration lag = std::chrono::steady_clock::duration::zero(); /// of oldest queued signal
+    std::chrono::steady_clock::duration maxLag = std::chrono::steady_clock::duration::zero();
+  };
+
+  /// Bounded queue between observable and one slow observer, so the observer lags behind
+  /// without delaying other observers or the connection.
+  class DeliveryQueue : public std::enable_shared_from_this<DeliveryQueue> {
+  protected:
+    class QueuedSignal {
+    public:
+      std::string signal;
+      nlohmann::json args;
+      std::chrono::steady_clock::time_point time;
+    };
+
+    Observer target;
+    DeliverySettings settings;
+    std::function<nlohmann::json ()> state;
+    std::mutex mutex;
+    std::deque<QueuedSignal> queue;
+    bool draining;
+    DeliveryMetrics counters;
+
+    void push(std::string signal, nlohmann::json args);
+    bool conflate(const std::string& signal, const nlohmann::json& args);
+    void resync();
+    void drain();
+
+  public:
+    /// Observe and unobserve with this observer instead of target
+    Observer observer;
+
+    DeliveryQueue(Observer targetp, DeliverySettings settingsp, std::function<nlohmann::json ()> statep);
+    void init();
+
+    DeliveryMetrics metrics();
+  };
+
+}
+
+#endif //LIVECHANGE_DELIVERYQUEUE_H
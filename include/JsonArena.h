@@ -0,0 +1,69 @@
+#ifndef LIVECHANGE_JSONARENA_H
+#define LIVECHANGE_JSONARENA_H
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cassert>
+#include <nlohmann/json.hpp>
+
+namespace livechange {
+
+  /// Bump allocator for short lived JSON trees. Memory is released all at once by reset(),
+  /// up to keptChunks standard sized chunks are kept for the next use.
+  class JsonArena {
+  protected:
+    size_t chunkSize;
+    size_t keptChunks;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::vector<std::unique_ptr<char[]>> largeChunks;
+    size_t chunkIndex;
+    size_t offset;
+
+  public:
+    static thread_local JsonArena* current;
+
+    /// Makes arena current for this thread until end of scope
+    class Scope {
+    protected:
+      JsonArena* previous;
+    public:
+      Scope(JsonArena& arena) : previous(current) {
+        current = &arena;
+      }
+      ~Scope() {
+        current = previous;
+      }
+    };
+
+    JsonArena(size_t chunkSizep = 64 * 1024, size_t keptChunksp = 2);
+
+    void* allocate(size_t size, size_t alignment);
+    void reset();
+  };
+
+  template<typename T> class ArenaAllocator {
+  public:
+    using value_type = T;
+
+    ArenaAllocator() {}
+    template<typename U> ArenaAllocator(const ArenaAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+      assert(JsonArena::current && "ArenaJson allocated outside of JsonArena::Scope");
+      return static_cast<T*>(JsonArena::current->allocate(count * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) {
+    }
+
+    template<typename U> bool operator==(const ArenaAllocator<U>&) const { return true; }
+    template<typename U> bool operator!=(const ArenaAllocator<U>&) const { return false; }
+  };
+
+  /// JSON tree allocated from JsonArena::current, convert to nlohmann::json to keep it longer
+  using ArenaJson = nlohmann::basic_json<std::map, std::vector, std::string, bool,
+                                         std::int64_t, std::uint64_t, double, ArenaAllocator>;
+
+}
+
+#endif //LIVECHANGE_JSONARENA_H
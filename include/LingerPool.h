@@ -0,0 +1,37 @@
+#ifndef LIVECHANGE_LINGERPOOL_H
+#define LIVECHANGE_LINGERPOOL_H
+
+#include <map>
+#include <memory>
+#include <cstddef>
+#include "Threading.h"
+
+namespace livechange {
+
+  class Observation;
+
+  /// Memory budget shared by lingering observations of many connections.
+  /// Over budget, least recently used observations are marked for eviction and their
+  /// connection is woken to unobserve them, so only the owning connection changes their signals.
+  class LingerPool {
+  protected:
+    Mutex mutex; /// guards members below, nothing is called while held
+    size_t budget;
+    std::map<Observation*, std::weak_ptr<Observation>> observations;
+
+  public:
+    LingerPool(size_t budgetp = 16 * 1024 * 1024);
+
+    /// Pool used by connections unless Connection::setLingerPool is called
+    static std::shared_ptr<LingerPool> shared();
+
+    void setBudget(size_t bytes);
+    void add(std::shared_ptr<Observation> observation);
+    void remove(Observation* observation);
+    /// Marks observations for eviction until estimated size of the rest fits in budget
+    void enforce();
+  };
+
+}
+
+#endif //LIVECHANGE_LINGERPOOL_H
@@ -16,12 +16,27 @@ namespace livechange {
   using DisposeCallback = std::shared_ptr<std::function<void ()>>;
   using RespawnCallback = std::shared_ptr<std::function<void ()>>;
 
+  class DeliveryQueue;
+  class DeliverySettings;
+
   class Observable {
   protected:
     std::vector<Observer> observers;
     bool disposed;
+    bool batching = false;
+    nlohmann::json batchApplied; /// signals that changed state since beginBatch
+    bool snapshotsEnabled = false;
+    uint64_t version = 0;
+
+    void fireObservers(const std::string& signal, const nlohmann::json& args);
+
+    /// Signals applied between beginBatch and endBatch are not fired one by one,
+    /// observers get one "batch" signal with those that changed state, or nothing when none did.
+    void beginBatch();
+    void endBatch();
 
-    void fireObservers(const std::string& signal, const nlohmann::json& args) const;
+    /// Makes current state visible to snapshot readers on other threads
+    virtual void publish();
 
     virtual void dispose();
     virtual void respawn();
@@ -35,6 +50,13 @@ namespace livechange {
     virtual void observe(const Observer observer);
     virtual void unobserve(const Observer observer);
 
+    /// Observer gets signals through its own bounded queue, unobserve with queue->observer.
+    /// Include DeliveryQueue.h to use.
+    std::shared_ptr<DeliveryQueue> observeQueued(const Observer observer, const DeliverySettings& settings);
+
+    /// Current state as argument of "set" signal, used to resync lagging observers
+    virtual nlohmann::json state();
+
     bool isUseless() {
       return observers.size() == 0;
     }
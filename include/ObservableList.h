@@ -9,16 +9,51 @@
 
 namespace livechange {
 
+  using ListChunk = std::vector<std::shared_ptr<const nlohmann::json>>;
+
+  /// Immutable state of list, chunks not changed by an update are shared between versions
+  class ListSnapshot {
+  public:
+    uint64_t version = 0;
+    std::vector<std::shared_ptr<const ListChunk>> chunks;
+    std::vector<size_t> offsets; /// index of first element of each chunk
+
+    size_t size() const {
+      return chunks.size() == 0 ? 0 : offsets.back() + chunks.back()->size();
+    }
+    const nlohmann::json& operator[](size_t index) const;
+  };
+
   class ObservableList : public Observable, public std::enable_shared_from_this<ObservableList> {
   protected:
     bool initialized;
+    static const size_t chunkSize = 64; /// publish copies one chunk per changed element and a pointer per chunk
+    std::vector<std::shared_ptr<const ListChunk>> chunks;
+    std::shared_ptr<const ListSnapshot> published;
+
+    size_t findChunk(size_t& index) const;
+    void rebuildChunks();
+    void elementSet(size_t index, const nlohmann::json& element);
+    void elementInsert(size_t index, const nlohmann::json& element);
+    void elementErase(size_t index);
+    virtual void publish() override;
+
+    bool reconcileEnabled = false;
+    bool reconciling = false; /// one snapshot is published after all reconcile signals
+    std::string reconcileField;
+    bool listHashValid = false;
+    size_t listHash = 0;
+
+    /// Applies new state as minimal put/update/remove signals, returns false when set should be used instead
+    bool reconcile(const nlohmann::json& value);
   public:
-    nlohmann::json list;
+    nlohmann::json list; /// only safe to read from the thread delivering signals, use snapshot() elsewhere
 
     ObservableList();
     void init();
 
     void set(nlohmann::json value);
+    void batch(nlohmann::json signals);
     void push(nlohmann::json value);
     //void unshift(nlohmann::json value);
     //void pop();
@@ -38,10 +73,20 @@ namespace livechange {
 
     virtual void observe(const Observer observer) override;
     virtual void unobserve(const Observer observer) override;
+    virtual nlohmann::json state() override;
 
     bool isInitialized() {
       return initialized;
     }
+
+    /// Call from the thread delivering signals before snapshot() is used
+    void enableSnapshots();
+    /// Safe from any thread, null until snapshots are enabled
+    std::shared_ptr<const ListSnapshot> snapshot() const;
+
+    /// Full set is turned into signals for changed elements only, matched by field.
+    /// Used when both lists are sorted by field, like lists maintained by putByField.
+    void enableReconcile(std::string field = "id");
   };
 
 }
@@ -9,26 +9,48 @@
 
 namespace livechange {
 
+  class ValueSnapshot {
+  public:
+    uint64_t version = 0;
+    nlohmann::json value;
+  };
+
   class ObservableValue : public Observable, public std::enable_shared_from_this<ObservableValue> {
   protected:
     bool initialized;
+    std::shared_ptr<const ValueSnapshot> published;
+
+    virtual void publish() override;
+
+    bool reconcileEnabled = false;
+    size_t valueHash = 0;
   public:
-    nlohmann::json value;
+    nlohmann::json value; /// only safe to read from the thread delivering signals, use snapshot() elsewhere
 
     ObservableValue();
     void init();
 
     void set(nlohmann::json value);
+    void batch(nlohmann::json signals);
 
     static const int type = 0x01;
     virtual int observableType() override;
 
     virtual void observe(const Observer observer) override;
     virtual void unobserve(const Observer observer) override;
+    virtual nlohmann::json state() override;
 
     bool isInitialized() {
       return initialized;
     }
+
+    /// Call from the thread delivering signals before snapshot() is used
+    void enableSnapshots();
+    /// Safe from any thread, null until snapshots are enabled
+    std::shared_ptr<const ValueSnapshot> snapshot() const;
+
+    /// Set with value equal to current one is ignored
+    void enableReconcile();
   };
 
 }
@@ -0,0 +1,63 @@
+#ifndef LIVECHANGE_RUNTIME_H
+#define LIVECHANGE_RUNTIME_H
+
+#include <memory>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+
+namespace livechange {
+
+  class Connection;
+
+  class RuntimeTimer {
+  public:
+    std::chrono::steady_clock::time_point at;
+    std::weak_ptr<Connection> connection;
+    uint64_t generation; /// only the latest timer scheduled by connection is handled
+
+    bool operator>(const RuntimeTimer& other) const {
+      return at > other.at;
+    }
+  };
+
+  class RuntimeLoop {
+  public:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::priority_queue<RuntimeTimer, std::vector<RuntimeTimer>, std::greater<RuntimeTimer>> timers;
+    bool stopped = false;
+    std::thread thread;
+  };
+
+  /// Fixed pool of threads handling request timeouts and batch deadlines of many connections,
+  /// replacing the thread every Connection starts on its own.
+  class Runtime {
+  protected:
+    std::vector<std::shared_ptr<RuntimeLoop>> loops;
+    std::atomic<size_t> nextLoop;
+
+    static void run(RuntimeLoop& loop);
+
+  public:
+    Runtime(size_t threads = std::thread::hardware_concurrency());
+    ~Runtime();
+
+    /// Returns index of the loop the connection should schedule on
+    size_t attach();
+    void schedule(size_t loop, std::weak_ptr<Connection> connection, std::chrono::steady_clock::time_point at,
+                  uint64_t generation);
+
+    size_t threadsCount() const {
+      return loops.size();
+    }
+  };
+
+}
+
+#endif //LIVECHANGE_RUNTIME_H
@@ -0,0 +1,29 @@
+#ifndef LIVECHANGE_SNAPSHOTSTORE_H
+#define LIVECHANGE_SNAPSHOTSTORE_H
+
+#include <string>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+
+namespace livechange {
+
+  /// On-disk cache of observation signals, one memory-mapped file per path.
+  /// Snapshots written with different version are ignored, so bumping it invalidates the cache.
+  class SnapshotStore {
+  protected:
+    std::string directory;
+    uint64_t version;
+
+    std::string fileName(const nlohmann::json& path) const;
+
+  public:
+    SnapshotStore(std::string directoryp, uint64_t versionp = 0);
+
+    /// Returns null when there is no valid snapshot for path
+    nlohmann::json load(const nlohmann::json& path) const;
+    bool save(const nlohmann::json& path, const nlohmann::json& signals) const;
+  };
+
+}
+
+#endif //LIVECHANGE_SNAPSHOTSTORE_H
@@ -0,0 +1,23 @@
+#ifndef LIVECHANGE_THREADING_H
+#define LIVECHANGE_THREADING_H
+
+#include <mutex>
+
+namespace livechange {
+
+#ifdef LIVECHANGE_SINGLE_THREADED
+  /// Everything runs on one thread, locking compiles to nothing.
+  /// Timeouts are not run by a thread, call Connection::poll from the event loop instead.
+  class Mutex {
+  public:
+    void lock() {}
+    void unlock() {}
+    bool try_lock() { return true; }
+  };
+#else
+  using Mutex = std::mutex;
+#endif
+
+}
+
+#endif //LIVECHANGE_THREADING_H
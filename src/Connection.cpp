@@ -3,6 +3,31 @@
 
 namespace livechange {
 
+  static size_t estimateSize(const nlohmann::json& value) {
+    size_t size = sizeof(nlohmann::json);
+    if(value.is_string()) {
+      size += value.get_ref<const std::string&>().size();
+    } else if(value.is_object()) {
+      for(auto it = value.begin(); it != value.end(); ++it) {
+        size += it.key().size() + estimateSize(it.value());
+      }
+    } else if(value.is_array()) {
+      for(auto& element : value) size += estimateSize(element);
+    }
+    return size;
+  }
+
+  static nlohmann::json batchOf(const std::vector<nlohmann::json>& signals) {
+    nlohmann::json batch = nlohmann::json::array();
+    for(auto& signal : signals) {
+      batch.push_back({
+        { "signal", signal["signal"] },
+        { "args", signal["args"] }
+      });
+    }
+    return batch;
+  }
+
   void Observation::addReactions(std::shared_ptr<Observable> observable) {
     auto disposeHandler = std::make_shared<std::function<void()>>(
         [observable, this]{
@@ -15,15 +40,46 @@ namespace livechange {
           this->addObservable(observable);
         }
     );
-    observable->onDispose.push_back(respawnHandler);
+    observable->onRespawn.push_back(respawnHandler);
+  }
+
+  void Observation::loadSnapshot() {
+    snapshotLoaded = true;
+    if(cachedSignals.size() > 0) return;
+    auto connectionPtr = connection.lock();
+    if(!connectionPtr || !connectionPtr->snapshotStore) return;
+    nlohmann::json signals = connectionPtr->snapshotStore->load(path);
+    if(!signals.is_array()) return;
+    for(auto& signal : signals) {
+      cachedSignals.push_back(std::move(signal));
+    }
+    fromSnapshot = cachedSignals.size() > 0;
+  }
+
+  void Observation::saveSnapshot() {
+    if(!snapshotDirty || fromSnapshot || cachedSignals.size() == 0) return;
+    auto connectionPtr = connection.lock();
+    if(!connectionPtr || !connectionPtr->snapshotStore) return;
+    if(connectionPtr->snapshotStore->save(path, cachedSignals)) snapshotDirty = false;
   }
 
   void Observation::addObservable(std::shared_ptr<Observable> observable) {
-    std::lock_guard<std::mutex> guard(stateMutex);
+    std::lock_guard<Mutex> guard(stateMutex);
     observables.push_back(observable);
+    if(!snapshotLoaded) loadSnapshot();
+    bool wasLingering = lingering; // still observed on server, cachedSignals are up to date
+    lingering = false;
     auto connectionPtr = connection.lock();
     if(!connectionPtr) return;
-    if (observables.size() == 1 && connectionPtr->isConnected()) {
+    if(wasLingering) {
+      std::lock_guard<Mutex> observationsGuard(connectionPtr->observationsMutex);
+      auto& list = connectionPtr->lingeringObservations;
+      list.erase(std::remove_if(list.begin(), list.end(), [this](auto& o) { return o.get() == this; }),
+                 list.end());
+      connectionPtr->lingerPool->remove(this);
+    }
+    lingerEvicted = false;
+    if (observables.size() == 1 && !wasLingering && connectionPtr->isConnected()) {
       nlohmann::json msg = {
           { "type", "observe" },
           { "what", path },
@@ -32,8 +88,12 @@ namespace livechange {
       connectionPtr->send(msg);
     }
     Observer observer = observable->observer;
-    for (auto signal : cachedSignals) {
-      (*observer)(signal["signal"], signal["args"]);
+    if(settings.batchSignals) {
+      if(cachedSignals.size() > 0) (*observer)("batch", batchOf(cachedSignals));
+    } else {
+      for (auto signal : cachedSignals) {
+        (*observer)(signal["signal"], signal["args"]);
+      }
     }
   }
 
@@ -41,70 +101,172 @@ namespace livechange {
   }
 
   void Observation::handleConnect() {
-    cachedSignals.clear();
-    if(observables.size() > 0) {
+    bool resume = settings.resume && hasSequence && !resyncing;
+    resumePending = resume;
+    if(!fromSnapshot && !resume) { // snapshot stays until live state arrives
+      cachedSignals.clear();
+      hasSequence = false;
+    }
+    pendingSignals.clear();
+    if(observables.size() > 0 || lingering) {
       nlohmann::json msg = {
           { "type", "observe" },
           { "what", path },
           { "pushed", false }
       };
+      if(resume) msg["resume"] = lastSequence; // server sends signals after it, or full set
       auto connectionPtr = connection.lock();
       if(!connectionPtr) return;
       connectionPtr->send(msg);
     }
   }
-  void Observation::handleNotifyMessage(const nlohmann::json& message) {
-    this->cachedSignals.push_back(message);
+  void Observation::handleNotifyMessage(nlohmann::json message) {
+    if(fromSnapshot) {
+      cachedSignals.clear();
+      fromSnapshot = false;
+    }
+    bool isSet = message["signal"] == "set";
+    if(message.contains("seq")) {
+      uint64_t sequence = message["seq"];
+      if(resyncing && !isSet) return; // waiting for full state, resync clears hasSequence
+      if(hasSequence && !(isSet && resumePending)) { // server restart can start sequence over
+        if(sequence <= lastSequence) return; // already applied before reconnect, or stale set
+        if(!isSet && sequence != lastSequence + 1) {
+          resync();
+          return;
+        }
+      }
+      hasSequence = true;
+      lastSequence = sequence;
+      resyncing = false;
+      resumePending = false;
+    }
+    snapshotDirty = true;
+    if(isSet && !settings.batchSignals) { // older signals are overwritten
+      cachedSignals.clear();
+      lingerSize = 0;
+    }
+    if(lingering) lingerSize += estimateSize(message);
+    if(settings.batchSignals) {
+      if(pendingSignals.size() == 0) {
+        batchDeadline = std::chrono::steady_clock::now() + settings.batchWindow;
+      }
+      pendingSignals.push_back(std::move(message));
+      return;
+    }
+    this->cachedSignals.push_back(std::move(message));
+    size_t index = cachedSignals.size() - 1;
+    for(auto observable : observables) {
+      Observer observer = observable->observer;
+      (*observer)(cachedSignals[index]["signal"], cachedSignals[index]["args"]);
+    }
+  }
+  void Observation::flushSignals() {
+    if(pendingSignals.size() == 0) return;
+    nlohmann::json batch = batchOf(pendingSignals);
+    for(auto& signal : pendingSignals) {
+      if(signal["signal"] == "set") cachedSignals.clear();
+      cachedSignals.push_back(std::move(signal));
+    }
+    pendingSignals.clear();
     for(auto observable : observables) {
       Observer observer = observable->observer;
-      (*observer)(message["signal"], message["args"]);
+      (*observer)("batch", batch);
     }
   }
 
+  void Observation::resync() {
+    resyncing = true;
+    hasSequence = false;
+    auto connectionPtr = connection.lock();
+    if(!connectionPtr || !connectionPtr->isConnected()) return;
+    connectionPtr->send({
+      { "type", "unobserve" },
+      { "what", path },
+      { "pushed", false }
+    });
+    connectionPtr->send({
+      { "type", "observe" },
+      { "what", path },
+      { "pushed", false }
+    });
+  }
+
   void Observation::removeObservable(std::shared_ptr<Observable> observable) {
-    std::lock_guard<std::mutex> guard(stateMutex);
+    std::shared_ptr<Observation> self; // map can hold last reference, released after guard
+    std::lock_guard<Mutex> guard(stateMutex);
     observables.erase(std::remove_if(observables.begin(), observables.end(),
                                    [&observable](auto o) { return o == observable; } ));
     if (observables.size() == 0) {
       auto connectionPtr = connection.lock();
       if(!connectionPtr) return;
-      if(connectionPtr->isConnected()) {
-        nlohmann::json msg = {
-            {"type",   "unobserve"},
-            {"what",   path},
-            {"pushed", false}
-        };
-        connectionPtr->send(msg.dump());
+      if(settings.linger.count() > 0) {
+        if(!lingering) {
+          std::lock_guard<Mutex> observationsGuard(connectionPtr->observationsMutex);
+          auto it = connectionPtr->observations.find(path);
+          if(it != connectionPtr->observations.end() && it->second.get() == this) {
+            connectionPtr->lingeringObservations.push_back(it->second);
+            connectionPtr->lingerPool->add(it->second);
+          }
+        }
+        lingering = true;
+        lingerStart = std::chrono::steady_clock::now();
+        lingerDeadline = lingerStart + settings.linger;
+        lingerSize = 0;
+        for(auto& signal : cachedSignals) lingerSize += estimateSize(signal);
+        connectionPtr->scheduleTimeouts(lingerStart); // check memory budget
+        return;
       }
-      cachedSignals.clear();
-      connectionPtr->observations.erase(path); // TODO: analyze if this can lead to observation duplication
+      stopObserving(connectionPtr);
+      self = connectionPtr->findObservation(path);
+      connectionPtr->forgetObservation(this); // TODO: analyze if this can lead to observation duplication
     }
   }
 
+  void Observation::stopObserving(std::shared_ptr<Connection> connectionPtr) {
+    if(connectionPtr->isConnected()) {
+      nlohmann::json msg = {
+          {"type",   "unobserve"},
+          {"what",   path},
+          {"pushed", false}
+      };
+      connectionPtr->send(msg);
+    }
+    saveSnapshot();
+    cachedSignals.clear();
+    pendingSignals.clear();
+    fromSnapshot = false;
+    snapshotDirty = false;
+    lingering = false;
+    lingerEvicted = false;
+    hasSequence = false;
+    resyncing = false;
+    resumePending = false;
+  }
+
   Request::Request(std::shared_ptr<Connection> connectionp, int requestIdp,
                    nlohmann::json msgp, RequestSettings settingsp)
                    : connection(connectionp), requestId(requestIdp),
-                   message(msgp), settings(settingsp) {
-    message["requestId"] = requestId;
+                   hasTimeout(true), settings(settingsp) {
+    msgp["requestId"] = requestId;
+    data = msgp.dump();
     startPoint = std::chrono::steady_clock::now();
     timeoutPoint = startPoint + settings.timeout;
     resultPromise = std::make_shared<Promise<nlohmann::json>>();
   }
-  void Request::handleMessage(const nlohmann::json message) {
+  void Request::handleMessage(const ArenaJson& message) {
     if(message["type"] == "error") {
-      resultPromise->reject(std::make_exception_ptr(RemoteError(message["error"])));
+      resultPromise->reject(std::make_exception_ptr(RemoteError(nlohmann::json(message["error"]))));
     } else {
       if(message.contains("response")) {
-        printf("RESOLVE PROMISE %s\n", message["response"].dump(2).c_str());
-        resultPromise->resolve(message["response"]);
+        resultPromise->resolve(nlohmann::json(message["response"]));
       } else {
-        printf("RESOLVE PROMISE undefined converted to null\n");
         resultPromise->resolve(nullptr);
       }
     }
   }
   void Request::handleDisconnect() {
-    std::lock_guard<std::mutex> guard(stateMutex);
+    std::lock_guard<Mutex> guard(stateMutex);
     if(settings.queueWhenDisconnected) {
       auto sentTimeout = std::chrono::steady_clock::now() + settings.sentTimeout;
       auto timeout = startPoint + settings.timeout;
@@ -121,152 +283,518 @@ namespace livechange {
     resultPromise->reject(std::make_exception_ptr(TimeoutError()));
   }
 
-  Connection::Connection(std::string urlp, nlohmann::json sessionIdp) : url(urlp), sessionId(sessionIdp),
-    lastRequestId(0), connectedCounter(0) {
+  Connection::Connection(std::string urlp, nlohmann::json sessionIdp, ObservationSettings observationSettingsp)
+    : url(urlp), sessionId(sessionIdp), observationSettings(observationSettingsp),
+    lastRequestId(0), corked(0), frameBatching(false), connectedCounter(0), socketGeneration(0),
+    runtimeLoop(0), runtimeTimerScheduled(false), runtimeTimerGeneration(0), lingerPool(LingerPool::shared()),
+    heartbeatActive(false), heartbeatPending(false), lastHeartbeatId(0), missedHeartbeats(0), linkDead(false),
+    rttMeasured(false), smoothedRtt(0), rttVariation(0) {
   }
   Connection::~Connection() {
 
   }
+  bool Connection::processTimeouts(std::chrono::steady_clock::time_point now,
+                                   std::chrono::steady_clock::time_point& next_timeout) {
+    bool nextFound = false;
+    // Run timeouts:
+    for(int i = 0; i < waitingRequests.size(); i++) {
+      auto request = waitingRequests[i];
+      if(request->hasTimeout && request->timeoutPoint < now) {
+        request->handleTimeout();
+        waitingRequests.erase(waitingRequests.begin() + i);
+        i--;
+      }
+    }
+    for(int i = 0; i < requestsQueue.size(); i++) {
+      auto request = requestsQueue[i];
+      if(request->hasTimeout && request->timeoutPoint < now) {
+        request->handleTimeout();
+        requestsQueue.erase(requestsQueue.begin() + i);
+        i--;
+      }
+    }
+    flushBatches(now);
+    expireLingering(now);
+    if(heartbeatActive && nextHeartbeat <= now) {
+      if(heartbeatPending) missedHeartbeats++;
+      if(missedHeartbeats >= heartbeatSettings.maxMissed) {
+        linkDead = true;
+        handleDisconnected();
+        if(webSocket) webSocket->closeConnection(); // can call onClose synchronously
+      } else {
+        heartbeatPending = true;
+        heartbeatSent = now;
+        nextHeartbeat = now + heartbeatSettings.interval;
+        send({
+          { "type", "ping" },
+          { "heartbeat", ++lastHeartbeatId }
+        });
+      }
+    }
+    // Find next timeout:
+    for(auto request : waitingRequests) {
+      if(request->hasTimeout && !nextFound || request->timeoutPoint < next_timeout) {
+        nextFound = true;
+        next_timeout = request->timeoutPoint;
+      }
+    }
+    for(auto request : requestsQueue) {
+      if(request->hasTimeout && !nextFound || request->timeoutPoint < next_timeout) {
+        nextFound = true;
+        next_timeout = request->timeoutPoint;
+      }
+    }
+    for(auto observation : batchingObservations) {
+      if(!nextFound || observation->batchDeadline < next_timeout) {
+        nextFound = true;
+        next_timeout = observation->batchDeadline;
+      }
+    }
+    if(heartbeatActive && (!nextFound || nextHeartbeat < next_timeout)) {
+      nextFound = true;
+      next_timeout = nextHeartbeat;
+    }
+    std::vector<std::shared_ptr<Observation>> lingering;
+    {
+      std::lock_guard<Mutex> guard(observationsMutex);
+      lingering = lingeringObservations;
+    }
+    for(auto& observation : lingering) {
+      std::lock_guard<Mutex> guard(observation->stateMutex);
+      if(observation->lingering && (!nextFound || observation->lingerDeadline < next_timeout)) {
+        nextFound = true;
+        next_timeout = observation->lingerDeadline;
+      }
+    }
+    return nextFound;
+  }
+
+  void Connection::expireLingering(std::chrono::steady_clock::time_point now) {
+    std::vector<std::shared_ptr<Observation>> candidates;
+    {
+      std::lock_guard<Mutex> guard(observationsMutex);
+      if(lingeringObservations.size() == 0) return;
+      candidates = lingeringObservations;
+    }
+    lingerPool->enforce(); // can mark observations of this and other connections
+    for(auto& observation : candidates) {
+      std::lock_guard<Mutex> guard(observation->stateMutex);
+      if(!observation->lingering) continue;
+      if(observation->lingerDeadline <= now || observation->lingerEvicted) {
+        observation->stopObserving(shared_from_this());
+        forgetObservation(observation.get());
+      }
+    }
+  }
+
+  std::shared_ptr<Observation> Connection::findObservation(const nlohmann::json& path) {
+    std::lock_guard<Mutex> guard(observationsMutex);
+    auto it = observations.find(path);
+    if(it == observations.end()) return nullptr;
+    return it->second;
+  }
+
+  std::vector<std::shared_ptr<Observation>> Connection::allObservations() {
+    std::lock_guard<Mutex> guard(observationsMutex);
+    std::vector<std::shared_ptr<Observation>> result;
+    result.reserve(observations.size());
+    for(auto& pair : observations) result.push_back(pair.second);
+    return result;
+  }
+
+  void Connection::forgetObservation(Observation* observation) {
+    std::lock_guard<Mutex> guard(observationsMutex);
+    auto it = observations.find(observation->path);
+    if(it != observations.end() && it->second.get() == observation) observations.erase(it);
+    lingeringObservations.erase(std::remove_if(lingeringObservations.begin(), lingeringObservations.end(),
+                                               [observation](auto& o) { return o.get() == observation; }),
+                                lingeringObservations.end());
+    lingerPool->remove(observation);
+  }
+
+  void Connection::scheduleTimeouts(std::chrono::steady_clock::time_point at) {
+    if(!runtime) {
+#ifndef LIVECHANGE_SINGLE_THREADED
+      wakeTimeoutThread();
+#else
+      if(timeoutWake) timeoutWake(at);
+#endif
+      return;
+    }
+    std::lock_guard<Mutex> guard(runtimeTimerMutex);
+    if(runtimeTimerScheduled && runtimeTimerPoint <= at) return;
+    runtimeTimerScheduled = true;
+    runtimeTimerPoint = at;
+    runtime->schedule(runtimeLoop, shared_from_this(), at, ++runtimeTimerGeneration);
+  }
+
+  void Connection::handleRuntimeTimer(uint64_t generation) {
+    {
+      std::lock_guard<Mutex> guard(runtimeTimerMutex);
+      if(!runtimeTimerScheduled || generation != runtimeTimerGeneration) return; // replaced by earlier timer
+      runtimeTimerScheduled = false;
+    }
+    std::lock_guard<Mutex> guard(stateMutex);
+    std::chrono::steady_clock::time_point next_timeout;
+    if(processTimeouts(std::chrono::steady_clock::now(), next_timeout)) {
+      scheduleTimeouts(next_timeout);
+    }
+  }
+
   void Connection::init() {
-    std::lock_guard<std::mutex> guard(stateMutex);
+#ifndef LIVECHANGE_SINGLE_THREADED
+    std::lock_guard<Mutex> guard(stateMutex);
     std::weak_ptr self = shared_from_this();
     timeoutThread = std::thread([self](){
       while(true) {
         std::chrono::steady_clock::time_point next_timeout;
         std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
-        bool nextFound = false;
         {
           std::shared_ptr<Connection> ptr = self.lock();
           if(!ptr) break;
-          std::unique_lock<std::mutex> guard(ptr->stateMutex);
-          // Run timeouts:
-          for(int i = 0; i < ptr->waitingRequests.size(); i++) {
-            auto request = ptr->waitingRequests[i];
-            if(request->hasTimeout && request->timeoutPoint < now) {
-              request->handleTimeout();
-              ptr->waitingRequests.erase(ptr->waitingRequests.begin() + i);
-              i--;
-            }
-          }
-          for(int i = 0; i < ptr->requestsQueue.size(); i++) {
-            auto request = ptr->requestsQueue[i];
-            if(request->hasTimeout && request->timeoutPoint < now) {
-              request->handleTimeout();
-              ptr->requestsQueue.erase(ptr->requestsQueue.begin() + i);
-              i--;
-            }
-          }
-          // Find next timeout:
-          for(auto request : ptr->waitingRequests) {
-            if(request->hasTimeout && !nextFound || request->timeoutPoint < next_timeout) {
-              nextFound = true;
-              next_timeout = request->timeoutPoint;
-            }
-          }
-          for(auto request : ptr->requestsQueue) {
-            if(request->hasTimeout && !nextFound || request->timeoutPoint < next_timeout) {
-              nextFound = true;
-              next_timeout = request->timeoutPoint;
+          bool nextFound;
+          {
+            std::lock_guard<std::mutex> guard(ptr->stateMutex);
+            {
+              std::lock_guard<std::mutex> wakeGuard(ptr->timeoutWakeMutex);
+              ptr->timeoutRescan = false;
             }
+            nextFound = ptr->processTimeouts(now, next_timeout);
           }
+          std::unique_lock<std::mutex> wakeGuard(ptr->timeoutWakeMutex);
+          auto rescan = [&ptr]() { return ptr->timeoutRescan; };
           if(!nextFound) {
-            ptr->timeoutCondition.wait(guard);
+            ptr->timeoutCondition.wait(wakeGuard, rescan);
           } else {
-            ptr->timeoutCondition.wait_until(guard, next_timeout);
+            ptr->timeoutCondition.wait_until(wakeGuard, next_timeout, rescan);
           }
         }
       }
     });
+#endif
+  }
+
+#ifndef LIVECHANGE_SINGLE_THREADED
+  void Connection::wakeTimeoutThread() {
+    {
+      std::lock_guard<std::mutex> guard(timeoutWakeMutex);
+      timeoutRescan = true;
+    }
+    timeoutCondition.notify_one();
   }
+#endif
+
+  std::chrono::steady_clock::time_point Connection::poll(std::chrono::steady_clock::time_point now) {
+    std::lock_guard<Mutex> guard(stateMutex);
+    std::chrono::steady_clock::time_point next_timeout;
+    if(!processTimeouts(now, next_timeout)) return std::chrono::steady_clock::time_point::max();
+    return next_timeout;
+  }
+
+#ifdef LIVECHANGE_SINGLE_THREADED
+  void Connection::setTimeoutWake(std::function<void(std::chrono::steady_clock::time_point)> wake) {
+    timeoutWake = wake;
+  }
+#endif
+
+#ifndef LIVECHANGE_SINGLE_THREADED
+  void Connection::init(std::shared_ptr<Runtime> runtimep) {
+    std::lock_guard<Mutex> guard(stateMutex);
+    runtime = runtimep;
+    runtimeLoop = runtime->attach();
+  }
+#endif
 
   void Connection::send(const nlohmann::json& msg) {
-    printf("SEND MSG %s\n", msg.dump(2).c_str());
-    webSocket->send(msg.dump(), wsxx::WebSocket::PacketType::Text);
+    sendData(msg.dump());
+  }
+
+  void Connection::sendData(const std::string& data) {
+    {
+      std::lock_guard<Mutex> guard(sendMutex);
+      if(corked > 0) {
+        outgoingBatch.push_back(data);
+        return;
+      }
+    }
+    webSocket->send(data, wsxx::WebSocket::PacketType::Text);
+  }
+
+  void Connection::sendData(std::string&& data) {
+    {
+      std::lock_guard<Mutex> guard(sendMutex);
+      if(corked > 0) {
+        outgoingBatch.push_back(std::move(data));
+        return;
+      }
+    }
+    webSocket->send(std::move(data), wsxx::WebSocket::PacketType::Text);
+  }
+
+  void Connection::cork() {
+    std::lock_guard<Mutex> guard(sendMutex);
+    corked++;
+  }
+  void Connection::uncork() {
+    std::vector<std::string> batch;
+    {
+      std::lock_guard<Mutex> guard(sendMutex);
+      corked--;
+      if(corked > 0) return;
+      batch.swap(outgoingBatch);
+    }
+    if(batch.size() == 0) return;
+    if(frameBatching && batch.size() > 1) {
+      size_t size = batch.size() + 1;
+      for(auto& data : batch) size += data.size();
+      std::string frame;
+      frame.reserve(size);
+      for(auto& data : batch) {
+        frame += frame.empty() ? '[' : ',';
+        frame += data;
+      }
+      frame += ']';
+      webSocket->send(std::move(frame), wsxx::WebSocket::PacketType::Text);
+    } else {
+      for(auto& data : batch) {
+        webSocket->send(std::move(data), wsxx::WebSocket::PacketType::Text);
+      }
+    }
   }
 
   std::shared_ptr<Promise<nlohmann::json>> Connection::sendRequest(
       const nlohmann::json& msg, RequestSettings settings) {
-    std::lock_guard<std::mutex> guard(stateMutex);
-
+    std::lock_guard<Mutex> guard(stateMutex);
+    adaptTimeout(settings);
     auto request = std::make_shared<Request>(shared_from_this(), ++lastRequestId, msg, settings);
     if(isConnected()) {
       waitingRequests.push_back(request);
-      send(request->message);
+      sendData(request->data);
     } else {
       requestsQueue.push_back(request);
     }
-    timeoutCondition.notify_one();
+    scheduleTimeouts(request->timeoutPoint);
     return request->resultPromise;
   }
 
-  void Connection::handleOpen() {
-    std::lock_guard<std::mutex> guard(stateMutex);
+  std::vector<std::shared_ptr<Promise<nlohmann::json>>> Connection::sendRequests(
+      const std::vector<nlohmann::json>& msgs, RequestSettings settings) {
+    std::lock_guard<Mutex> guard(stateMutex);
+    std::vector<std::shared_ptr<Promise<nlohmann::json>>> promises;
+    if(msgs.size() == 0) return promises;
+    promises.reserve(msgs.size());
+    adaptTimeout(settings);
+    bool connected = isConnected();
+    auto startPoint = std::chrono::steady_clock::now();
+    cork();
+    for(auto& msg : msgs) {
+      auto request = std::make_shared<Request>(shared_from_this(), ++lastRequestId, msg, settings);
+      request->startPoint = startPoint;
+      request->timeoutPoint = startPoint + settings.timeout;
+      if(connected) {
+        waitingRequests.push_back(request);
+        sendData(request->data);
+      } else {
+        requestsQueue.push_back(request);
+      }
+      promises.push_back(request->resultPromise);
+    }
+    uncork();
+    scheduleTimeouts(startPoint + settings.timeout);
+    return promises;
+  }
+
+  void Connection::adaptTimeout(RequestSettings& settings) {
+    if(settings.adaptiveTimeout && rttMeasured) {
+      auto adaptive = std::max(settings.minTimeout, roundTripTimeout());
+      if(adaptive < settings.timeout) settings.timeout = adaptive;
+    }
+  }
+
+  void Connection::handleOpen(uint64_t generation) {
+    std::lock_guard<Mutex> guard(stateMutex);
+    if(generation != socketGeneration) return;
     connectedCounter++;
+    linkDead = false;
+    heartbeatActive = heartbeatSettings.enabled;
+    if(heartbeatActive) {
+      heartbeatPending = false;
+      missedHeartbeats = 0;
+      nextHeartbeat = std::chrono::steady_clock::now() + heartbeatSettings.interval;
+      scheduleTimeouts(nextHeartbeat);
+    }
+    cork();
     send({
       { "type", "initializeSession" },
       { "sessionId", sessionId }
     });
-    for(auto pair : observations) {
-      pair.second->handleConnect();
+    for(auto& observation : allObservations()) {
+      observation->handleConnect();
     }
     for(auto request : requestsQueue) {
       this->waitingRequests.push_back(request);
-      send(request->message);
+      sendData(request->data);
     }
     requestsQueue.clear();
+    uncork();
   }
-  void Connection::handleMessage(std::string data, wsxx::WebSocket::PacketType type) {
-    std::lock_guard<std::mutex> guard(stateMutex);
+  void Connection::handleMessage(const std::string& data, wsxx::WebSocket::PacketType type,
+                                 uint64_t generation) {
+    std::lock_guard<Mutex> guard(stateMutex);
+    if(generation != socketGeneration) return;
 
    // printf("HANDLE MESSAGE %d\n", type);
 
     if(type == wsxx::WebSocket::PacketType::Text) {
-      auto msg = nlohmann::json::parse(data);
-      printf("RECV MSG %s\n", msg.dump(2).c_str());
-      std::string type = msg["type"];
-      if(type == "pong") {
-
-      } else if(type == "ping") {
-        msg["type"] = "pong";
-        send(msg);
-      } else if(type == "authenticationError") {
-        // TODO: signal error
-        this->webSocket->closeConnection();
-      } else if(msg.contains("responseId")) {
-        int responseId = msg["responseId"];
-        printf("RESPONSE MSG %d\n", responseId);
-        for(int i = 0; i < waitingRequests.size(); i++) {
-          auto request = waitingRequests[i];
-          printf("WAITING REQUEST %d\n", request->requestId);
-          if(request->requestId == responseId) {
-            request->handleMessage(msg);
-            waitingRequests.erase(waitingRequests.begin() + i);
-            timeoutCondition.notify_one();
-            break;
-          }
+      {
+        receiveArena.reset();
+        JsonArena::Scope arenaScope(receiveArena);
+        auto msg = ArenaJson::parse(data);
+        if(msg.is_array()) {
+          for(auto& part : msg) handleMessageObject(part);
+        } else {
+          handleMessageObject(msg);
         }
-      } else if(type == "notify") {
-        auto it = observations.find(msg["what"]);
-        if(it != observations.end()) {
-          it->second->handleNotifyMessage(msg);
+      }
+      if(batchingObservations.size() > 0) {
+        flushBatches(std::chrono::steady_clock::now());
+        if(batchingObservations.size() > 0) {
+          scheduleTimeouts(batchingObservations.front()->batchDeadline);
         }
-      //} else if(type == "push") {
-      //} else if(type == "unpush") {
+      }
+    }
+  }
+  void Connection::handleMessageObject(ArenaJson& msg) {
+    std::string type = msg["type"];
+    if(type == "pong") {
+      handlePong(msg);
+    } else if(type == "ping") {
+      msg["type"] = "pong";
+      sendData(msg.dump());
+    } else if(type == "authenticationError") {
+      // TODO: signal error
+      this->webSocket->closeConnection();
+    } else if(msg.contains("responseId")) {
+      int responseId = msg["responseId"];
+      for(int i = 0; i < waitingRequests.size(); i++) {
+        auto request = waitingRequests[i];
+        if(request->requestId == responseId) {
+          request->handleMessage(msg);
+          waitingRequests.erase(waitingRequests.begin() + i);
+#ifndef LIVECHANGE_SINGLE_THREADED
+          if(!runtime) wakeTimeoutThread();
+#endif
+          break;
+        }
+      }
+    } else if(type == "notify") {
+      auto observation = findObservation(nlohmann::json(msg["what"]));
+      if(observation) {
+        bool wasPending = observation->pendingSignals.size() > 0;
+        observation->handleNotifyMessage(nlohmann::json(msg)); // retained, moved out of arena
+        if(!wasPending && observation->pendingSignals.size() > 0) {
+          batchingObservations.push_back(observation);
+        }
+      }
+    //} else if(type == "push") {
+    //} else if(type == "unpush") {
+    } else {
+      throw std::runtime_error(std::string("unknown message type: ") + type);
+    }
+  }
+
+  void Connection::flushBatches(std::chrono::steady_clock::time_point now, bool force) {
+    for(size_t i = 0; i < batchingObservations.size(); ) {
+      auto observation = batchingObservations[i];
+      if(force || observation->batchDeadline <= now) {
+        observation->flushSignals();
+        batchingObservations.erase(batchingObservations.begin() + i);
       } else {
-        throw std::runtime_error(std::string("unknown message type: ") + type);
+        i++;
       }
     }
   }
-  void Connection::handleClose(int code, std::string reason, bool wasClean) {
-    std::lock_guard<std::mutex> guard(stateMutex);
+
+  void Connection::handleClose(int code, std::string reason, bool wasClean, uint64_t generation) {
+    if(linkDead) return; // already handled, stateMutex can be held by heartbeat closing the socket
+    std::lock_guard<Mutex> guard(stateMutex);
+    if(generation != socketGeneration) return; // late close of replaced socket
+    handleDisconnected();
+  }
+
+  void Connection::handleDisconnected() {
+    heartbeatActive = false;
+    flushBatches(std::chrono::steady_clock::now(), true);
+    if(snapshotStore) {
+      for(auto& observation : allObservations()) {
+        observation->saveSnapshot();
+      }
+    }
     for(auto request : waitingRequests) {
       request->handleDisconnect();
     }
     waitingRequests.clear();
-    for(auto pair : observations) {
-      pair.second->handleDisconnect();
+    for(auto& observation : allObservations()) {
+      observation->handleDisconnect();
+    }
+    scheduleTimeouts(std::chrono::steady_clock::now());
+  }
+
+  void Connection::handlePong(const ArenaJson& msg) {
+    missedHeartbeats = 0; // any pong means the link is alive
+    if(!heartbeatPending || !msg.contains("heartbeat") || msg["heartbeat"] != lastHeartbeatId) return;
+    heartbeatPending = false;
+    auto sample = std::chrono::steady_clock::now() - heartbeatSent;
+    if(!rttMeasured) {
+      rttMeasured = true;
+      smoothedRtt = sample;
+      rttVariation = sample / 2;
+    } else { // RFC 6298 smoothing
+      auto error = smoothedRtt > sample ? smoothedRtt - sample : sample - smoothedRtt;
+      rttVariation = (rttVariation * 3 + error) / 4;
+      smoothedRtt = (smoothedRtt * 7 + sample) / 8;
+    }
+  }
+
+  std::chrono::steady_clock::duration Connection::roundTripTimeout() {
+    return smoothedRtt + rttVariation * 4;
+  }
+
+  void Connection::setHeartbeat(HeartbeatSettings settings) {
+    std::lock_guard<Mutex> guard(stateMutex);
+    heartbeatSettings = settings;
+  }
+
+  std::chrono::steady_clock::duration Connection::roundTripTime() {
+    std::lock_guard<Mutex> guard(stateMutex);
+    return smoothedRtt;
+  }
+
+  std::chrono::steady_clock::duration Connection::roundTripJitter() {
+    std::lock_guard<Mutex> guard(stateMutex);
+    return rttVariation;
+  }
+
+  void Connection::setFrameBatching(bool enabled) {
+    std::lock_guard<Mutex> guard(sendMutex);
+    frameBatching = enabled;
+  }
+
+  void Connection::setSnapshotStore(std::shared_ptr<SnapshotStore> store) {
+    std::lock_guard<Mutex> guard(stateMutex);
+    snapshotStore = store;
+  }
+
+  void Connection::setLingerPool(std::shared_ptr<LingerPool> pool) {
+    std::lock_guard<Mutex> guard(stateMutex);
+    lingerPool = pool;
+  }
+
+  void Connection::saveSnapshots() {
+    std::lock_guard<Mutex> guard(stateMutex);
+    for(auto& observation : allObservations()) {
+      observation->saveSnapshot();
     }
-    timeoutCondition.notify_one();
   }
 
   bool Connection::isConnected() {
@@ -277,23 +805,37 @@ namespace livechange {
   }
 
   void Connection::connect() {
-    std::lock_guard<std::mutex> guard(stateMutex);
+    std::lock_guard<Mutex> guard(stateMutex);
     std::weak_ptr self = shared_from_this(); // shared_ptr will make circular reference with webSocket
-    auto onOpen = [self]() {
+    uint64_t generation = ++socketGeneration;
+    auto onOpen = [self, generation]() {
       std::shared_ptr ptr = self.lock();
-      if(ptr) ptr->handleOpen();
+      if(ptr) ptr->handleOpen(generation);
     };
-    auto onWsMessage = [self](std::string data, wsxx::WebSocket::PacketType type) {
+    auto onWsMessage = [self, generation](std::string data, wsxx::WebSocket::PacketType type) {
       std::shared_ptr ptr = self.lock();
-      if(ptr) ptr->handleMessage(data, type);
+      if(ptr) ptr->handleMessage(data, type, generation); // by reference, frame is not copied again
     };
-    auto onWsClose = [self](int code, std::string reason, bool wasClean) {
+    auto onWsClose = [self, generation](int code, std::string reason, bool wasClean) {
       std::shared_ptr ptr = self.lock();
-      if(ptr) ptr->handleClose(code, reason, wasClean);
+      if(ptr) ptr->handleClose(code, reason, wasClean, generation);
     };
     webSocket = std::make_shared<wsxx::WebSocket>(url, onOpen, onWsMessage, onWsClose);
   }
 
+  void Connection::disconnect() {
+    std::shared_ptr<wsxx::WebSocket> socket;
+    {
+      std::lock_guard<Mutex> guard(stateMutex);
+      if(!webSocket) return;
+      socket.swap(webSocket);
+      socketGeneration++;
+      linkDead = true;
+      handleDisconnected();
+    }
+    socket->closeConnection(); // can call onClose synchronously
+  }
+
   std::shared_ptr<Promise<nlohmann::json>> Connection::get(nlohmann::json path,
                                                    RequestSettings settings) {
     return sendRequest({
@@ -301,6 +843,41 @@ namespace livechange {
            { "what", path }
        }, settings);
   }
+  std::shared_ptr<Promise<PathResults>> Connection::getMany(std::vector<nlohmann::json> paths,
+                                                           RequestSettings settings) {
+    auto resultPromise = std::make_shared<Promise<PathResults>>();
+    auto results = std::make_shared<PathResults>();
+    auto remaining = std::make_shared<size_t>(paths.size());
+    if(paths.size() == 0) {
+      resultPromise->resolve(*results);
+      return resultPromise;
+    }
+    auto finish = [resultPromise, results, remaining]() {
+      (*remaining)--;
+      if(*remaining == 0) resultPromise->resolve(*results);
+    };
+    std::vector<nlohmann::json> msgs;
+    msgs.reserve(paths.size());
+    for(auto& path : paths) {
+      msgs.push_back({
+        { "type", "get" },
+        { "what", path }
+      });
+    }
+    auto promises = sendRequests(msgs, settings);
+    for(size_t i = 0; i < paths.size(); i++) {
+      const nlohmann::json& path = paths[i];
+      promises[i]->onRejected([path, results, finish](std::exception_ptr error) {
+        (*results)[path].error = error;
+        finish();
+      });
+      promises[i]->onResolved([path, results, finish](nlohmann::json& result) {
+        (*results)[path].result = result;
+        finish();
+      });
+    }
+    return resultPromise;
+  }
   std::shared_ptr<Promise<nlohmann::json>> Connection::request(nlohmann::json method, nlohmann::json args,
                                                        RequestSettings settings) {
     return sendRequest({
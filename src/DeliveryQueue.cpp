@@ -0,0 +1,99 @@
+#include "DeliveryQueue.h"
+
+namespace livechange {
+
+  DeliveryQueue::DeliveryQueue(Observer targetp, DeliverySettings settingsp, std::function<nlohmann::json ()> statep)
+    : target(targetp), settings(settingsp), state(statep), draining(false) {
+  }
+
+  void DeliveryQueue::init() {
+    std::weak_ptr<DeliveryQueue> self = shared_from_this();
+    observer = std::make_shared<ObserverFunction>([self](std::string signal, nlohmann::json args) {
+      std::shared_ptr<DeliveryQueue> ptr = self.lock();
+      if(ptr) ptr->push(std::move(signal), std::move(args));
+    });
+  }
+
+  void DeliveryQueue::push(std::string signal, nlohmann::json args) {
+    bool startDrain = false;
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      if(queue.size() < settings.capacity) {
+        queue.push_back({ std::move(signal), std::move(args), std::chrono::steady_clock::now() });
+      } else if(settings.overflow != OverflowPolicy::Conflate || !conflate(signal, args)) {
+        resync();
+      }
+      if(!draining) {
+        draining = true;
+        startDrain = true;
+      }
+    }
+    if(!startDrain) return;
+    if(settings.executor) {
+      std::shared_ptr<DeliveryQueue> self = shared_from_this();
+      settings.executor([self]() { self->drain(); });
+    } else {
+      drain();
+    }
+  }
+
+  bool DeliveryQueue::conflate(const std::string& signal, const nlohmann::json& args) {
+    if(signal == "set") {
+      counters.conflated += queue.size();
+      auto time = queue.size() > 0 ? queue.front().time : std::chrono::steady_clock::now();
+      queue.clear();
+      queue.push_back({ signal, args, time });
+      return true;
+    }
+    if(signal == "updateByField") {
+      for(auto it = queue.rbegin(); it != queue.rend(); ++it) {
+        if(it->signal == "set") return false;
+        if(it->signal == "updateByField" && it->args[0] == args[0] && it->args[1] == args[1]) {
+          it->args[2] = args[2]; // keeps oldElement of earlier update
+          counters.conflated++;
+          return true;
+        }
+        if(it->signal != "updateByField") return false; // other signals could depend on order
+      }
+    }
+    return false;
+  }
+
+  void DeliveryQueue::resync() {
+    counters.resyncs++;
+    counters.conflated += queue.size();
+    auto time = queue.size() > 0 ? queue.front().time : std::chrono::steady_clock::now();
+    queue.clear();
+    // Observable fires after applying signal, so current state includes the dropped one
+    queue.push_back({ "set", nlohmann::json::array({ state() }), time });
+  }
+
+  void DeliveryQueue::drain() {
+    while(true) {
+      QueuedSignal next;
+      {
+        std::lock_guard<std::mutex> guard(mutex);
+        if(queue.size() == 0) {
+          draining = false;
+          return;
+        }
+        next = std::move(queue.front());
+        queue.pop_front();
+        auto lag = std::chrono::steady_clock::now() - next.time;
+        if(lag > counters.maxLag) counters.maxLag = lag;
+        counters.delivered++;
+      }
+      (*target)(next.signal, next.args);
+    }
+  }
+
+  DeliveryMetrics DeliveryQueue::metrics() {
+    std::lock_guard<std::mutex> guard(mutex);
+    DeliveryMetrics result = counters;
+    result.queued = queue.size();
+    result.lag = queue.size() > 0 ? std::chrono::steady_clock::now() - queue.front().time
+                                  : std::chrono::steady_clock::duration::zero();
+    return result;
+  }
+
+}
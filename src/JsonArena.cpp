@@ -0,0 +1,41 @@
+#include "JsonArena.h"
+
+namespace livechange {
+
+  thread_local JsonArena* JsonArena::current = nullptr;
+
+  JsonArena::JsonArena(size_t chunkSizep, size_t keptChunksp)
+    : chunkSize(chunkSizep), keptChunks(keptChunksp), chunkIndex(0), offset(0) {
+  }
+
+  void* JsonArena::allocate(size_t size, size_t alignment) {
+    if(size + alignment > chunkSize) {
+      largeChunks.emplace_back(new char[size + alignment]);
+      void* ptr = largeChunks.back().get();
+      size_t space = size + alignment;
+      return std::align(alignment, size, ptr, space);
+    }
+    while(true) {
+      if(chunkIndex == chunks.size()) {
+        chunks.emplace_back(new char[chunkSize]);
+        offset = 0;
+      }
+      void* ptr = chunks[chunkIndex].get() + offset;
+      size_t space = chunkSize - offset;
+      if(std::align(alignment, size, ptr, space)) {
+        offset = static_cast<char*>(ptr) - chunks[chunkIndex].get() + size;
+        return ptr;
+      }
+      chunkIndex++;
+      offset = 0;
+    }
+  }
+
+  void JsonArena::reset() {
+    chunkIndex = 0;
+    offset = 0;
+    if(chunks.size() > keptChunks) chunks.resize(keptChunks); // one huge frame should not pin its memory
+    largeChunks.clear();
+  }
+
+}
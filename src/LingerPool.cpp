@@ -0,0 +1,79 @@
+#include "LingerPool.h"
+#include "Connection.h"
+
+#include <algorithm>
+
+namespace livechange {
+
+  LingerPool::LingerPool(size_t budgetp) : budget(budgetp) {
+  }
+
+  std::shared_ptr<LingerPool> LingerPool::shared() {
+    static std::shared_ptr<LingerPool> pool = std::make_shared<LingerPool>();
+    return pool;
+  }
+
+  void LingerPool::setBudget(size_t bytes) {
+    std::lock_guard<Mutex> guard(mutex);
+    budget = bytes;
+  }
+
+  void LingerPool::add(std::shared_ptr<Observation> observation) {
+    std::lock_guard<Mutex> guard(mutex);
+    observations[observation.get()] = observation;
+  }
+
+  void LingerPool::remove(Observation* observation) {
+    std::lock_guard<Mutex> guard(mutex);
+    observations.erase(observation);
+  }
+
+  void LingerPool::enforce() {
+    std::vector<std::shared_ptr<Observation>> lingering;
+    size_t limit;
+    {
+      std::lock_guard<Mutex> guard(mutex);
+      limit = budget;
+      for(auto it = observations.begin(); it != observations.end();) {
+        auto observation = it->second.lock();
+        if(!observation) {
+          it = observations.erase(it);
+          continue;
+        }
+        lingering.push_back(observation);
+        ++it;
+      }
+    }
+    struct Candidate {
+      std::shared_ptr<Observation> observation;
+      std::chrono::steady_clock::time_point lingerStart;
+      size_t size;
+    };
+    std::vector<Candidate> candidates;
+    size_t size = 0;
+    for(auto& observation : lingering) {
+      std::lock_guard<Mutex> guard(observation->stateMutex);
+      if(!observation->lingering || observation->lingerEvicted) continue;
+      candidates.push_back({ observation, observation->lingerStart, observation->lingerSize });
+      size += candidates.back().size;
+    }
+    if(size <= limit) return;
+    std::sort(candidates.begin(), candidates.end(), [](auto& a, auto& b) {
+      return a.lingerStart < b.lingerStart;
+    });
+    auto now = std::chrono::steady_clock::now();
+    for(auto& candidate : candidates) { // least recently used first
+      std::shared_ptr<Connection> connection;
+      {
+        std::lock_guard<Mutex> guard(candidate.observation->stateMutex);
+        if(!candidate.observation->lingering || candidate.observation->lingerEvicted) continue;
+        candidate.observation->lingerEvicted = true;
+        connection = candidate.observation->connection.lock();
+      }
+      if(connection) connection->scheduleTimeouts(now); // owner unobserves it
+      size -= std::min(size, candidate.size);
+      if(size <= limit) break;
+    }
+  }
+
+}
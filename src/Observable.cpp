@@ -1,4 +1,5 @@
 #include "Observable.h"
+#include "DeliveryQueue.h"
 
 namespace livechange {
 
@@ -6,10 +7,30 @@ namespace livechange {
     return Observable::type;
   }
 
-  void Observable::fireObservers(const std::string& signal, const nlohmann::json& args) const {
+  void Observable::fireObservers(const std::string& signal, const nlohmann::json& args) {
+    if(batching) {
+      batchApplied.push_back({ { "signal", signal }, { "args", args } });
+      return;
+    }
     for(auto observer : observers) (*observer)(signal, args);
   }
 
+  void Observable::beginBatch() {
+    batching = true;
+    batchApplied = nlohmann::json::array();
+  }
+  void Observable::endBatch() {
+    batching = false;
+    nlohmann::json signals;
+    signals.swap(batchApplied);
+    if(signals.size() == 0) return; // only no-op signals
+    publish();
+    fireObservers("batch", signals);
+  }
+
+  void Observable::publish() {
+  }
+
   void Observable::dispose() {
     disposed = true;
     for(auto callback : onDispose) (*callback)();
@@ -23,6 +44,18 @@ namespace livechange {
     observers.push_back(observer);
   }
 
+  std::shared_ptr<DeliveryQueue> Observable::observeQueued(const Observer observer,
+                                                          const DeliverySettings& settings) {
+    auto queue = std::make_shared<DeliveryQueue>(observer, settings, [this]() { return state(); });
+    queue->init();
+    observe(queue->observer);
+    return queue;
+  }
+
+  nlohmann::json Observable::state() {
+    return nullptr;
+  }
+
   void Observable::unobserve(const Observer observer) {
     observers.erase(std::remove_if(observers.begin(), observers.end(),
                                    [&observer](Observer o) { return o == observer; } ));
@@ -9,6 +9,8 @@ namespace livechange {
   void handleListSignal(std::shared_ptr<ObservableList> list, std::string signal, nlohmann::json args) {
     if(signal == "set") {
       list->set(args[0]);
+    } else if(signal == "batch") {
+      list->batch(args);
     } else if(signal == "push") {
       list->push(args[0]);
     } else if(signal == "putByField") {
@@ -36,13 +38,30 @@ namespace livechange {
   }
 
   void ObservableList::set(nlohmann::json value) {
+    if(reconcileEnabled && reconcile(value)) return;
     list = value;
+    listHashValid = false;
+    if(snapshotsEnabled) {
+      rebuildChunks();
+      publish();
+    }
     nlohmann::json args = nlohmann::json::array({ value });
     this->fireObservers("set", args);
   }
 
+  void ObservableList::batch(nlohmann::json signals) {
+    beginBatch();
+    for(auto& signal : signals) {
+      handleListSignal(shared_from_this(), signal["signal"], signal["args"]);
+    }
+    endBatch();
+  }
+
   void ObservableList::push(nlohmann::json value) {
     list.push_back(value);
+    listHashValid = false;
+    elementInsert(list.size() - 1, value);
+    publish();
     nlohmann::json args = nlohmann::json::array({ value });
     this->fireObservers("push", args);
   }
@@ -53,42 +72,53 @@ namespace livechange {
   //void splice(size_t at, size_t del, nlohmann::json value);
   void ObservableList::putByField(std::string field, nlohmann::json value, nlohmann::json element, bool reverse,
                   nlohmann::json oldElement) {
+    listHashValid = false;
     if(!reverse) {
       for(size_t i = 0; i < list.size(); i++) {
         if(list[i][field] == value) {
           list[i] = element;
+          elementSet(i, element);
           goto done;
         } else if(this->list[i][field] > value) {
           list.insert(list.begin() + i, element);
+          elementInsert(i, element);
           goto done;
         }
       }
       list.push_back(element);
+      elementInsert(list.size() - 1, element);
     } else {
-      for(size_t i = list.size()-1; i >= 0; i --) {
+      for(size_t i = list.size(); i-- > 0; ) {
         if(list[i][field] == value) {
           list[i] = element;
+          elementSet(i, element);
           goto done;
         } else if(list[i][field] > value) {
-          list.insert(list.begin()+i, element);
+          list.insert(list.begin() + i + 1, element);
+          elementInsert(i + 1, element);
           goto done;
         }
       }
       list.insert(list.begin(), element);
+      elementInsert(0, element);
     }
     done:
+    publish();
     nlohmann::json args = nlohmann::json::array({ field, value, element, reverse, oldElement });
     fireObservers("putByField", args);
   }
 
   //void remove(nlohmann::json element);
   void ObservableList::removeByField(std::string field, nlohmann::json value, nlohmann::json oldElement) {
+    listHashValid = false;
     for(size_t i = 0; i < list.size(); i++) {
       if(list[i][field] == value) {
         list.erase(i);
+        elementErase(i);
         i--;
       }
     }
+    publish();
     nlohmann::json args = nlohmann::json::array({ field, value, oldElement });
     fireObservers("removeByField", args);
   }
@@ -97,22 +127,175 @@ namespace livechange {
   //void update(nlohmann::json what, nlohmann::json with);
   void ObservableList::updateByField(std::string field, nlohmann::json value, nlohmann::json element,
                                      nlohmann::json oldElement) {
+    listHashValid = false;
     for(size_t i = 0; i < list.size(); i++) {
       if(list[i][field] == value) {
         list[i] = element;
+        elementSet(i, element);
       }
     }
+    publish();
     nlohmann::json args = nlohmann::json::array({ field, value, element, oldElement });
     fireObservers("updateByField", args);
   }
   //void updateBy(nlohmann::json fields, nlohmann::json with);
 
+  static bool sortedByKey(const nlohmann::json& list, const std::string& field) {
+    for(size_t i = 0; i < list.size(); i++) {
+      if(!list[i].is_object() || !list[i].contains(field)) return false;
+      if(i > 0 && !(list[i - 1][field] < list[i][field])) return false;
+    }
+    return true;
+  }
+
+  bool ObservableList::reconcile(const nlohmann::json& value) {
+    if(!list.is_array() || list.size() == 0 || !value.is_array()) return false;
+    size_t hash = std::hash<nlohmann::json>{}(value);
+    if(!listHashValid) {
+      listHash = std::hash<nlohmann::json>{}(list);
+      listHashValid = true;
+    }
+    if(hash == listHash && value == list) return true;
+    if(!sortedByKey(list, reconcileField) || !sortedByKey(value, reconcileField)) return false;
+
+    const std::string& field = reconcileField;
+    std::vector<size_t> removed, added, updated; // indexes in list, value, value
+    std::vector<size_t> updatedOld;
+    size_t i = 0, j = 0;
+    while(i < list.size() || j < value.size()) {
+      if(j == value.size() || (i < list.size() && list[i][field] < value[j][field])) {
+        removed.push_back(i++);
+      } else if(i == list.size() || value[j][field] < list[i][field]) {
+        added.push_back(j++);
+      } else {
+        if(list[i] != value[j]) {
+          updated.push_back(j);
+          updatedOld.push_back(i);
+        }
+        i++;
+        j++;
+      }
+    }
+    if(removed.size() + added.size() + updated.size() > value.size() / 2) return false; // set is cheaper
+
+    nlohmann::json old = list;
+    reconciling = true;
+    for(size_t index : removed) {
+      removeByField(field, old[index][field], old[index]);
+    }
+    for(size_t k = 0; k < updated.size(); k++) {
+      const nlohmann::json& element = value[updated[k]];
+      updateByField(field, element[field], element, old[updatedOld[k]]);
+    }
+    for(size_t index : added) {
+      putByField(field, value[index][field], value[index], false, nullptr);
+    }
+    reconciling = false;
+    publish();
+    listHash = hash;
+    listHashValid = true;
+    return true;
+  }
+
+  void ObservableList::enableReconcile(std::string field) {
+    reconcileEnabled = true;
+    reconcileField = field;
+  }
+
+  const nlohmann::json& ListSnapshot::operator[](size_t index) const {
+    size_t chunk = std::upper_bound(offsets.begin(), offsets.end(), index) - offsets.begin() - 1;
+    return *(*chunks[chunk])[index - offsets[chunk]];
+  }
+
+  size_t ObservableList::findChunk(size_t& index) const { // index becomes position in chunk
+    size_t chunk = 0;
+    while(chunk + 1 < chunks.size() && index >= chunks[chunk]->size()) {
+      index -= chunks[chunk]->size();
+      chunk++;
+    }
+    return chunk;
+  }
+
+  void ObservableList::rebuildChunks() {
+    chunks.clear();
+    std::shared_ptr<ListChunk> chunk;
+    for(auto& element : list) {
+      if(!chunk || chunk->size() == chunkSize) {
+        chunk = std::make_shared<ListChunk>();
+        chunk->reserve(chunkSize);
+        chunks.push_back(chunk);
+      }
+      chunk->push_back(std::make_shared<const nlohmann::json>(element));
+    }
+  }
+
+  void ObservableList::elementSet(size_t index, const nlohmann::json& element) {
+    if(!snapshotsEnabled) return;
+    size_t chunk = findChunk(index);
+    auto copy = std::make_shared<ListChunk>(*chunks[chunk]); // published chunks are immutable
+    (*copy)[index] = std::make_shared<const nlohmann::json>(element);
+    chunks[chunk] = copy;
+  }
+  void ObservableList::elementInsert(size_t index, const nlohmann::json& element) {
+    if(!snapshotsEnabled) return;
+    if(chunks.size() == 0) chunks.push_back(std::make_shared<ListChunk>());
+    size_t chunk = findChunk(index);
+    auto copy = std::make_shared<ListChunk>(*chunks[chunk]);
+    copy->insert(copy->begin() + index, std::make_shared<const nlohmann::json>(element));
+    chunks[chunk] = copy;
+    if(copy->size() >= 2 * chunkSize) { // split, so inserts keep copying at most two chunks
+      auto tail = std::make_shared<ListChunk>(copy->begin() + chunkSize, copy->end());
+      copy->resize(chunkSize);
+      chunks.insert(chunks.begin() + chunk + 1, tail);
+    }
+  }
+  void ObservableList::elementErase(size_t index) {
+    if(!snapshotsEnabled) return;
+    size_t chunk = findChunk(index);
+    if(chunks[chunk]->size() == 1) {
+      chunks.erase(chunks.begin() + chunk);
+      return;
+    }
+    auto copy = std::make_shared<ListChunk>(*chunks[chunk]);
+    copy->erase(copy->begin() + index);
+    chunks[chunk] = copy;
+  }
+
+  void ObservableList::publish() {
+    if(!snapshotsEnabled || batching || reconciling) return;
+    auto next = std::make_shared<ListSnapshot>();
+    next->version = ++version;
+    next->chunks = chunks; // chunks are shared with previous snapshots
+    next->offsets.reserve(chunks.size());
+    size_t offset = 0;
+    for(auto& chunk : chunks) {
+      next->offsets.push_back(offset);
+      offset += chunk->size();
+    }
+    std::atomic_store(&published, std::shared_ptr<const ListSnapshot>(next));
+  }
+
+  void ObservableList::enableSnapshots() {
+    if(snapshotsEnabled) return;
+    snapshotsEnabled = true;
+    rebuildChunks();
+    publish();
+  }
+
+  std::shared_ptr<const ListSnapshot> ObservableList::snapshot() const {
+    return std::atomic_load(&published);
+  }
+
   void ObservableList::observe(const Observer observer) {
     observers.push_back(observer);
     nlohmann::json args = { list };
     (*observer)("set", args);
   }
 
+  nlohmann::json ObservableList::state() {
+    return list;
+  }
+
   void ObservableList::unobserve(const Observer observer) {
     observers.erase(std::remove_if(observers.begin(), observers.end(),
                                    [&observer](Observer o) { return o == observer; } ));
@@ -9,6 +9,8 @@ namespace livechange {
   void handleValueSignal(std::shared_ptr<ObservableValue> observable, std::string signal, nlohmann::json args) {
     if(signal == "set") {
       observable->set(args[0]);
+    } else if(signal == "batch") {
+      observable->batch(args);
     } else {
       throw new std::runtime_error("signal " + signal + " not implemented");
     }
@@ -25,17 +27,58 @@ namespace livechange {
   }
 
   void ObservableValue::set(nlohmann::json value) {
+    if(reconcileEnabled) {
+      size_t hash = std::hash<nlohmann::json>{}(value);
+      if(hash == valueHash && value == this->value) return;
+      valueHash = hash;
+    }
     this->value = value;
+    publish();
     nlohmann::json args = nlohmann::json::array({ value });
     this->fireObservers("set", args);
   }
 
+  void ObservableValue::batch(nlohmann::json signals) {
+    beginBatch();
+    for(auto& signal : signals) {
+      handleValueSignal(shared_from_this(), signal["signal"], signal["args"]);
+    }
+    endBatch();
+  }
+
+  void ObservableValue::publish() {
+    if(!snapshotsEnabled || batching) return;
+    auto next = std::make_shared<ValueSnapshot>();
+    next->version = ++version;
+    next->value = value;
+    std::atomic_store(&published, std::shared_ptr<const ValueSnapshot>(next));
+  }
+
+  void ObservableValue::enableSnapshots() {
+    if(snapshotsEnabled) return;
+    snapshotsEnabled = true;
+    publish();
+  }
+
+  void ObservableValue::enableReconcile() {
+    reconcileEnabled = true;
+    valueHash = std::hash<nlohmann::json>{}(value);
+  }
+
+  std::shared_ptr<const ValueSnapshot> ObservableValue::snapshot() const {
+    return std::atomic_load(&published);
+  }
+
   void ObservableValue::observe(const Observer observer) {
     observers.push_back(observer);
     nlohmann::json args = nlohmann::json::array({ value });
     (*observer)("set", args);
   }
 
+  nlohmann::json ObservableValue::state() {
+    return value;
+  }
+
   void ObservableValue::unobserve(const Observer observer) {
     observers.erase(std::remove_if(observers.begin(), observers.end(),
                                    [&observer](Observer o) { return o == observer; } ));
@@ -0,0 +1,71 @@
+#include "Runtime.h"
+#include "Connection.h"
+
+namespace livechange {
+
+  Runtime::Runtime(size_t threads) : nextLoop(0) {
+    if(threads == 0) threads = 1;
+    for(size_t i = 0; i < threads; i++) {
+      loops.push_back(std::make_shared<RuntimeLoop>());
+    }
+    for(auto& loop : loops) {
+      std::shared_ptr<RuntimeLoop> loopPtr = loop; // keeps loop alive if thread gets detached
+      loop->thread = std::thread([loopPtr]() {
+        run(*loopPtr);
+      });
+    }
+  }
+
+  Runtime::~Runtime() {
+    for(auto& loop : loops) {
+      std::lock_guard<std::mutex> guard(loop->mutex);
+      loop->stopped = true;
+      loop->condition.notify_one();
+    }
+    for(auto& loop : loops) {
+      if(loop->thread.get_id() == std::this_thread::get_id()) {
+        loop->thread.detach(); // last connection released runtime from its own loop
+      } else {
+        loop->thread.join();
+      }
+    }
+  }
+
+  size_t Runtime::attach() {
+    return nextLoop++ % loops.size();
+  }
+
+  void Runtime::schedule(size_t loop, std::weak_ptr<Connection> connection,
+                         std::chrono::steady_clock::time_point at, uint64_t generation) {
+    RuntimeLoop& runtimeLoop = *loops[loop];
+    std::lock_guard<std::mutex> guard(runtimeLoop.mutex);
+    bool earliest = runtimeLoop.timers.empty() || at < runtimeLoop.timers.top().at;
+    runtimeLoop.timers.push({ at, connection, generation });
+    if(earliest) runtimeLoop.condition.notify_one();
+  }
+
+  void Runtime::run(RuntimeLoop& loop) {
+    std::unique_lock<std::mutex> guard(loop.mutex);
+    while(!loop.stopped) {
+      if(loop.timers.empty()) {
+        loop.condition.wait(guard);
+        continue;
+      }
+      auto at = loop.timers.top().at;
+      if(at > std::chrono::steady_clock::now()) {
+        loop.condition.wait_until(guard, at);
+        continue;
+      }
+      std::weak_ptr<Connection> connection = loop.timers.top().connection;
+      uint64_t generation = loop.timers.top().generation;
+      loop.timers.pop();
+      guard.unlock();
+      {
+        std::shared_ptr<Connection> ptr = connection.lock();
+        if(ptr) ptr->handleRuntimeTimer(generation);
+      }
+      guard.lock();
+    }
+  }
+
+}
@@ -0,0 +1,78 @@
+#include "SnapshotStore.h"
+
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace livechange {
+
+  static const char snapshotMagic[4] = { 'L', 'C', 'S', 'S' };
+  static const uint32_t snapshotFormat = 1;
+
+  struct SnapshotHeader {
+    char magic[4];
+    uint32_t format;
+    uint64_t version;
+  };
+
+  SnapshotStore::SnapshotStore(std::string directoryp, uint64_t versionp)
+    : directory(directoryp), version(versionp) {
+  }
+
+  std::string SnapshotStore::fileName(const nlohmann::json& path) const {
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016zx", std::hash<std::string>()(path.dump()));
+    return directory + "/" + hash + ".snapshot";
+  }
+
+  nlohmann::json SnapshotStore::load(const nlohmann::json& path) const {
+    int fd = open(fileName(path).c_str(), O_RDONLY);
+    if(fd < 0) return nullptr;
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size <= (off_t)sizeof(SnapshotHeader)) {
+      close(fd);
+      return nullptr;
+    }
+    size_t size = info.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) return nullptr;
+    const uint8_t* data = (const uint8_t*)mapped;
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    nlohmann::json snapshot = nullptr;
+    if(memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) == 0
+       && header.format == snapshotFormat && header.version == version) {
+      snapshot = nlohmann::json::from_cbor(data + sizeof(header), data + size, true, false);
+    }
+    munmap(mapped, size);
+    if(snapshot.is_discarded() || !snapshot.is_object() || snapshot["path"] != path) return nullptr;
+    return snapshot["signals"];
+  }
+
+  bool SnapshotStore::save(const nlohmann::json& path, const nlohmann::json& signals) const {
+    SnapshotHeader header;
+    memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.format = snapshotFormat;
+    header.version = version;
+    std::vector<uint8_t> body = nlohmann::json::to_cbor({
+      { "path", path },
+      { "signals", signals }
+    });
+    std::string file = fileName(path);
+    std::string tmpFile = file + ".tmp";
+    FILE* out = fopen(tmpFile.c_str(), "wb");
+    if(!out) return false;
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(body.data(), 1, body.size(), out) == body.size();
+    if(fclose(out) != 0 || !written) {
+      unlink(tmpFile.c_str());
+      return false;
+    }
+    return rename(tmpFile.c_str(), file.c_str()) == 0;
+  }
+
+}
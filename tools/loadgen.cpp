@@ -0,0 +1,236 @@
+// Load generator simulating many clients observing many paths.
+// Reports throughput, request latency percentiles, CPU per message and memory per observation.
+
+#include "Connection.h"
+#include "ObservableList.h"
+
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace livechange;
+
+struct LoadSettings {
+  std::string url = "ws://localhost:8001/api/ws";
+  size_t connections = 100;
+  size_t paths = 10;
+  std::string pathTemplate = "[\"demo\",\"items\",{\"group\":\"%d\"}]";
+  std::string getTemplate = "[\"demo\",\"item\",{\"item\":\"%d\"}]";
+  std::string method = ""; /// JSON method called by share of requests, it can trigger notifications
+  double methodRatio = -1; /// share of requests calling method, rest are gets; all of them when not given
+  double requestRate = 1; /// requests per connection per second
+  double duration = 30;
+  double reconnectEvery = 0; /// all connections reconnect at once every this many seconds
+  size_t threads = 0;
+};
+
+struct LoadStats {
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> methodCalls{0};
+  std::atomic<uint64_t> responses{0};
+  std::atomic<uint64_t> errors{0};
+  std::atomic<uint64_t> notifications{0};
+  std::mutex latencyMutex;
+  std::vector<double> latencies; /// milliseconds
+};
+
+static double rssBytes() {
+  long pages = 0, resident = 0;
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if(!statm) return 0;
+  if(fscanf(statm, "%ld %ld", &pages, &resident) != 2) resident = 0;
+  fclose(statm);
+  return double(resident) * sysconf(_SC_PAGESIZE);
+}
+
+static double cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static nlohmann::json formatPath(const std::string& pathTemplate, size_t index) {
+  std::string path = pathTemplate;
+  std::string number = std::to_string(index);
+  for(size_t at = path.find("%d"); at != std::string::npos; at = path.find("%d", at + number.size())) {
+    path.replace(at, 2, number);
+  }
+  return nlohmann::json::parse(path);
+}
+
+static double percentile(std::vector<double>& sorted, double p) {
+  if(sorted.size() == 0) return 0;
+  size_t index = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+  return sorted[index];
+}
+
+static bool parseArgs(int argc, char** argv, LoadSettings& settings) {
+  for(int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if(i + 1 >= argc) {
+      fprintf(stderr, "missing value for %s\n", arg.c_str());
+      return false;
+    }
+    std::string value = argv[++i];
+    if(arg == "--url") settings.url = value;
+    else if(arg == "--connections") settings.connections = std::stoul(value);
+    else if(arg == "--paths") settings.paths = std::stoul(value);
+    else if(arg == "--path") settings.pathTemplate = value;
+    else if(arg == "--get") settings.getTemplate = value;
+    else if(arg == "--method") settings.method = value;
+    else if(arg == "--method-ratio") settings.methodRatio = std::stod(value);
+    else if(arg == "--rate") settings.requestRate = std::stod(value);
+    else if(arg == "--duration") settings.duration = std::stod(value);
+    else if(arg == "--reconnect-every") settings.reconnectEvery = std::stod(value);
+    else if(arg == "--threads") settings.threads = std::stoul(value);
+    else {
+      fprintf(stderr, "unknown option %s\n", arg.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static void printUsage() {
+  fprintf(stderr,
+          "usage: loadgen [--url ws://host/api/ws] [--connections N] [--paths M]\n"
+          "               [--path JSON_WITH_%%d] [--get JSON_WITH_%%d] [--method JSON]\n"
+          "               [--method-ratio SHARE_OF_REQUESTS_0_TO_1]\n"
+          "               [--rate REQUESTS_PER_CONNECTION_PER_S] [--duration S]\n"
+          "               [--reconnect-every S] [--threads RUNTIME_THREADS]\n");
+}
+
+int main(int argc, char** argv) {
+  LoadSettings settings;
+  if(!parseArgs(argc, argv, settings)) {
+    printUsage();
+    return 1;
+  }
+  if(settings.connections == 0) {
+    fprintf(stderr, "--connections must be at least 1\n");
+    return 1;
+  }
+  if(settings.methodRatio < 0) settings.methodRatio = settings.method.empty() ? 0 : 1;
+  if(settings.methodRatio > 0 && settings.method.empty()) {
+    fprintf(stderr, "--method-ratio needs --method\n");
+    return 1;
+  }
+  LoadStats stats;
+  auto runtime = std::make_shared<Runtime>(settings.threads ? settings.threads
+                                                             : std::thread::hardware_concurrency());
+
+  double rssStart = rssBytes();
+  std::vector<std::shared_ptr<Connection>> connections;
+  std::vector<std::shared_ptr<ObservableList>> observables;
+  auto observer = std::make_shared<ObserverFunction>([&stats](std::string signal, nlohmann::json args) {
+    stats.notifications++;
+  });
+  for(size_t c = 0; c < settings.connections; c++) {
+    auto connection = std::make_shared<Connection>(settings.url, "loadgen_" + std::to_string(c));
+    connection->init(runtime);
+    connection->connect();
+    connections.push_back(connection);
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(2)); // let sockets open
+  double rssConnected = rssBytes();
+  for(size_t c = 0; c < settings.connections; c++) {
+    auto& connection = connections[c];
+    for(size_t p = 0; p < settings.paths; p++) {
+      auto observable = connection->observable<ObservableList>(
+          formatPath(settings.pathTemplate, (c * settings.paths + p) % (settings.paths * 10)));
+      observable->observe(observer);
+      observables.push_back(observable);
+    }
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(2)); // let initial sets arrive
+  double rssObserved = rssBytes();
+
+  auto sendRequest = [&settings, &stats](std::shared_ptr<Connection> connection, size_t index) {
+    RequestSettings requestSettings;
+    requestSettings.queueWhenDisconnected = true;
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<Promise<nlohmann::json>> promise;
+    // evenly spread: request calls method when running count of method calls crosses an integer
+    bool callMethod = size_t((index + 1) * settings.methodRatio) > size_t(index * settings.methodRatio);
+    if(!callMethod) {
+      promise = connection->get(formatPath(settings.getTemplate, index), requestSettings);
+    } else {
+      promise = connection->request(nlohmann::json::parse(settings.method),
+                                    nlohmann::json::array({ { { "index", index } } }), requestSettings);
+      stats.methodCalls++;
+    }
+    stats.requests++;
+    promise->onRejected([&stats](std::exception_ptr error) {
+      stats.errors++;
+    });
+    promise->onResolved([&stats, start](nlohmann::json& result) {
+      double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      stats.responses++;
+      std::lock_guard<std::mutex> guard(stats.latencyMutex);
+      stats.latencies.push_back(latency);
+    });
+  };
+
+  double cpuStart = cpuSeconds();
+  auto start = std::chrono::steady_clock::now();
+  auto end = start + std::chrono::duration<double>(settings.duration);
+  auto nextReconnect = start + std::chrono::duration<double>(settings.reconnectEvery);
+  double interval = 1.0 / (settings.requestRate * settings.connections);
+  auto nextRequest = start;
+  size_t requestIndex = 0;
+  size_t reconnects = 0;
+  while(std::chrono::steady_clock::now() < end) {
+    auto now = std::chrono::steady_clock::now();
+    if(settings.reconnectEvery > 0 && now >= nextReconnect) {
+      for(auto& connection : connections) {
+        connection->disconnect(); // old socket would stay open until its onClose
+        connection->connect();
+      }
+      reconnects++;
+      nextReconnect += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(settings.reconnectEvery));
+    }
+    while(settings.requestRate > 0 && nextRequest <= now) {
+      sendRequest(connections[requestIndex % connections.size()], requestIndex);
+      requestIndex++;
+      nextRequest += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(interval));
+    }
+    std::this_thread::sleep_until(std::min(nextRequest, now + std::chrono::milliseconds(10)));
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double cpu = cpuSeconds() - cpuStart;
+
+  std::vector<double> latencies;
+  {
+    std::lock_guard<std::mutex> guard(stats.latencyMutex);
+    latencies = stats.latencies;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  uint64_t messages = stats.responses + stats.notifications;
+  size_t observationsCount = settings.connections * settings.paths;
+
+  printf("connections:           %zu\n", settings.connections);
+  printf("observations:          %zu\n", observationsCount);
+  printf("reconnect storms:      %zu\n", reconnects);
+  printf("requests sent:         %llu (%llu method calls)\n", (unsigned long long)stats.requests.load(),
+         (unsigned long long)stats.methodCalls.load());
+  printf("responses:             %llu (%.1f/s)\n", (unsigned long long)stats.responses.load(),
+         stats.responses / elapsed);
+  printf("errors:                %llu\n", (unsigned long long)stats.errors.load());
+  printf("notifications:         %llu (%.1f/s)\n", (unsigned long long)stats.notifications.load(),
+         stats.notifications / elapsed);
+  printf("latency p50/p99/p999:  %.2f / %.2f / %.2f ms\n", percentile(latencies, 0.5),
+         percentile(latencies, 0.99), percentile(latencies, 0.999));
+  printf("cpu per message:       %.2f us\n", messages ? cpu * 1e6 / messages : 0.0);
+  printf("memory per connection: %.0f bytes\n", (rssConnected - rssStart) / settings.connections);
+  printf("memory per observation: %.0f bytes\n",
+         observationsCount ? (rssObserved - rssConnected) / observationsCount : 0.0);
+  printf("runtime threads:       %zu\n", runtime->threadsCount());
+  fflush(stdout);
+  _exit(0); // skip teardown of thousands of sockets
+}
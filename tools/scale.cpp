@@ -0,0 +1,117 @@
+// Opens many connections and reports how many threads and how much memory they take.
+// Compares connections sharing a Runtime with connections starting their own timeout thread.
+
+#include "Connection.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+using namespace livechange;
+
+struct ScaleSettings {
+  std::string url = "ws://localhost:8001/api/ws";
+  size_t connections = 1000;
+  size_t threads = 0; /// Runtime threads, 0 means hardware concurrency
+  bool ownThreads = false; /// init() instead of init(runtime)
+  double settle = 5; /// seconds to wait for sockets to open
+};
+
+static long statusField(const char* name) {
+  FILE* status = fopen("/proc/self/status", "r");
+  if(!status) return -1;
+  char line[256];
+  size_t length = strlen(name);
+  long value = -1;
+  while(fgets(line, sizeof(line), status)) {
+    if(strncmp(line, name, length) == 0 && line[length] == ':') {
+      value = atol(line + length + 1);
+      break;
+    }
+  }
+  fclose(status);
+  return value;
+}
+
+static void report(const char* stage, long threadsBase, long rssBase, size_t connections) {
+  long threads = statusField("Threads");
+  long rss = statusField("VmRSS"); // kB
+  printf("%-12s threads: %5ld  rss: %8ld kB", stage, threads, rss);
+  if(connections > 0) {
+    printf("  per connection: %.2f threads, %.1f kB",
+           double(threads - threadsBase) / connections, double(rss - rssBase) / connections);
+  }
+  printf("\n");
+}
+
+static bool parseArgs(int argc, char** argv, ScaleSettings& settings) {
+  for(int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if(arg == "--own-threads") {
+      settings.ownThreads = true;
+      continue;
+    }
+    if(i + 1 >= argc) {
+      fprintf(stderr, "missing value for %s\n", arg.c_str());
+      return false;
+    }
+    std::string value = argv[++i];
+    if(arg == "--url") settings.url = value;
+    else if(arg == "--connections") settings.connections = std::stoul(value);
+    else if(arg == "--threads") settings.threads = std::stoul(value);
+    else if(arg == "--settle") settings.settle = std::stod(value);
+    else {
+      fprintf(stderr, "unknown option %s\n", arg.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static void printUsage() {
+  fprintf(stderr,
+          "usage: scale [--url ws://host/api/ws] [--connections N] [--threads RUNTIME_THREADS]\n"
+          "             [--own-threads] [--settle S]\n");
+}
+
+int main(int argc, char** argv) {
+  ScaleSettings settings;
+  if(!parseArgs(argc, argv, settings)) {
+    printUsage();
+    return 1;
+  }
+  long threadsBase = statusField("Threads");
+  long rssBase = statusField("VmRSS");
+  report("start", threadsBase, rssBase, 0);
+
+  std::shared_ptr<Runtime> runtime;
+  if(!settings.ownThreads) {
+    runtime = std::make_shared<Runtime>(settings.threads ? settings.threads
+                                                         : std::thread::hardware_concurrency());
+    report("runtime", threadsBase, rssBase, 0);
+  }
+
+  std::vector<std::shared_ptr<Connection>> connections;
+  for(size_t c = 0; c < settings.connections; c++) {
+    auto connection = std::make_shared<Connection>(settings.url, "scale_" + std::to_string(c));
+    if(runtime) {
+      connection->init(runtime);
+    } else {
+      connection->init();
+    }
+    connections.push_back(connection);
+  }
+  report("initialized", threadsBase, rssBase, settings.connections);
+
+  for(auto& connection : connections) connection->connect();
+  std::this_thread::sleep_for(std::chrono::duration<double>(settings.settle));
+  size_t connected = 0;
+  for(auto& connection : connections) {
+    if(connection->isConnected()) connected++;
+  }
+  report("connected", threadsBase, rssBase, settings.connections);
+  printf("open sockets: %zu of %zu\n", connected, settings.connections);
+  fflush(stdout);
+  _exit(0); // skip teardown of thousands of sockets
+}